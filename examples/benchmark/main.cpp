@@ -0,0 +1,913 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dat-archive.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Benchmarks for the dat-archive library
+ * Build in release mode and run without arguments, results are printed as a table.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Generate names shaped like the paths typically stored in an archive
+ * @param count The number of names to generate
+ * @return The generated names
+ */
+static std::vector<std::string> generateNames(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back("assets/level_" + std::to_string(i % 97) + "/textures/texture_" + std::to_string(i) + ".png");
+    }
+
+    return names;
+}
+
+/**
+ * Time looking up every name in a random order
+ * @param names The names to look up
+ * @param lookup A function that looks up a name and returns something derived from the result
+ * @return The average time taken per lookup in nanoseconds
+ */
+template<typename Lookup>
+static double timeLookups(const std::vector<std::string>& names, Lookup lookup) {
+    std::vector<std::string_view> queries(names.begin(), names.end());
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(42));
+
+    const size_t rounds = std::max<size_t>(1, 2000000 / queries.size());
+    uint64_t sink = 0;
+
+    auto start = Clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (std::string_view query: queries) sink += lookup(query);
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Stop the lookups from being optimised away
+    if (sink == 0) std::cout << "";
+
+    return elapsed / (double) (rounds * queries.size());
+}
+
+/**
+ * Compare looking up entries through an EntryIndex against a std::map keyed by name
+ */
+static void benchmarkLookup() {
+    std::cout << "Lookup latency (ns per lookup)" << std::endl;
+    std::cout << "entries\tstd::map\tEntryIndex" << std::endl;
+
+    for (size_t count: {1000, 100000, 1000000}) {
+        std::vector<std::string> names = generateNames(count);
+
+        std::map<std::string, size_t, std::less<>> map;
+        for (size_t i = 0; i < names.size(); ++i) map.emplace(names[i], i);
+
+        DatArchive::EntryIndex index;
+        auto nameOf = [&names](size_t position) -> const std::string& { return names[position]; };
+        index.build(names.size(), nameOf);
+
+        double mapTime = timeLookups(names, [&map](std::string_view name) { return map.find(name)->second; });
+        double indexTime = timeLookups(names, [&index, &nameOf](std::string_view name) {
+            return index.find(name, nameOf);
+        });
+
+        std::cout << count << "\t" << mapTime << "\t\t" << indexTime << std::endl;
+    }
+}
+
+/**
+ * Write an archive containing a table of empty files, written directly rather than with DatArchiveWriter so very
+ * large tables can be produced without creating the files on disk
+ * @param path The path to write the archive to
+ * @param names The names of the files in the table
+ * @param version The version of the table to write, either 1 or 2
+ */
+static void writeTableOnlyArchive(const std::filesystem::path& path, std::vector<std::string> names, uint8_t version) {
+    std::ofstream archive(path, std::ios::binary | std::ios::trunc);
+
+    // Version 2 tables are aligned to 8 bytes
+    uint64_t tableOffset = version == 1 ? 13 : 16;
+    archive.write(DatArchive::DATFILESIGNATURE, 4);
+    archive.write(reinterpret_cast<const char*>(&version), 1);
+    archive.write(reinterpret_cast<const char*>(&tableOffset), 8);
+    archive.write("\0\0\0", (std::streamsize) tableOffset - 13);
+
+    if (version == 1) {
+        for (const std::string& name: names) {
+            uint16_t nameLength = name.size();
+            char zero[14] = {};
+
+            archive.write(reinterpret_cast<const char*>(&nameLength), 2);
+            archive.write(name.data(), nameLength);
+            archive.write(zero, 14);
+            archive.write(reinterpret_cast<const char*>(&tableOffset), 8);
+            archive.write(reinterpret_cast<const char*>(&tableOffset), 8);
+        }
+        return;
+    }
+
+    std::sort(names.begin(), names.end());
+
+    uint64_t entryCount = names.size();
+    uint64_t nameHeapSize = 0;
+    for (const std::string& name: names) nameHeapSize += name.size();
+
+    archive.write(reinterpret_cast<const char*>(&entryCount), 8);
+    archive.write(reinterpret_cast<const char*>(&nameHeapSize), 8);
+
+    uint64_t nameOffset = 0;
+    for (const std::string& name: names) {
+        DatArchive::EntryRecord record;
+        record.dataStart = tableOffset;
+        record.dataEnd = tableOffset;
+        record.nameOffset = nameOffset;
+        record.nameLength = name.size();
+        nameOffset += name.size();
+
+        archive.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    for (const std::string& name: names) archive.write(name.data(), (std::streamsize) name.size());
+}
+
+/**
+ * Time opening archives with large tables in each read mode
+ * <br>
+ * The archive is opened once before timing so the results reflect a warm page cache
+ */
+static void benchmarkOpen() {
+    std::cout << "Open time (ms per open)" << std::endl;
+    std::cout << "version\tentries\tSTREAM\tMAPPED\tPOSITIONAL" << std::endl;
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-open.dat";
+
+    // The third pass opens version 1 archives through an index file
+    for (int pass: {1, 2, 3}) {
+        for (size_t count: {1000, 100000, 1000000}) {
+            uint8_t version = pass == 2 ? 2 : 1;
+            writeTableOnlyArchive(path, generateNames(count), version);
+
+            std::cout << (pass == 3 ? "1 + idx" : std::to_string(version)) << "\t" << count;
+            for (DatArchive::ReadMode mode: {DatArchive::ReadMode::STREAM, DatArchive::ReadMode::MAPPED,
+                                             DatArchive::ReadMode::POSITIONAL}) {
+                DatArchive::ReaderOptions options;
+                options.readMode = mode;
+                options.useIndexFile = pass == 3;
+
+                DatArchive::DatArchiveReader warmup(path, options);
+                if (warmup.size() != count) std::cout << "Failed to open the benchmark archive" << std::endl;
+
+                const int rounds = 5;
+                auto start = Clock::now();
+                for (int round = 0; round < rounds; ++round) {
+                    DatArchive::DatArchiveReader reader(path, options);
+                }
+                auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+                std::cout << "\t" << elapsed / rounds;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    std::filesystem::path indexPath = path;
+    indexPath += ".idx";
+    std::filesystem::remove(indexPath);
+    std::filesystem::remove(path);
+}
+
+/**
+ * Time extracting a single large compressed file with different numbers of threads
+ */
+static void benchmarkParallelInflate() {
+    std::cout << "Parallel inflate (ms per extraction of a 256MiB file)" << std::endl;
+    std::cout << "threads\tSTREAM\tMAPPED\tPOSITIONAL" << std::endl;
+
+    std::filesystem::path inputPath = std::filesystem::temp_directory_path() / "dat-archive-benchmark-inflate.txt";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-inflate.dat";
+
+    // Text made of the generated names compresses about as well as typical text does
+    {
+        std::vector<std::string> names = generateNames(100000);
+        std::mt19937_64 random(42);
+        std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+
+        for (uint64_t written = 0; written < 268435456;) {
+            const std::string& name = names[random() % names.size()];
+            input << name << '\n';
+            written += name.size() + 1;
+        }
+    }
+
+    DatArchive::DatArchiveWriter writer;
+    writer.queueFile(inputPath, DatArchive::TableEntry("input.txt", DatArchive::CompressionMethod::ZLIB,
+                                                       DatArchive::Flags()));
+    writer.writeArchive(path, true);
+
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u}) {
+        std::cout << threads;
+        for (DatArchive::ReadMode mode: {DatArchive::ReadMode::STREAM, DatArchive::ReadMode::MAPPED,
+                                         DatArchive::ReadMode::POSITIONAL}) {
+            DatArchive::ReaderOptions options;
+            options.readMode = mode;
+            options.threadCount = threads;
+            options.parallelInflate = true;
+
+            DatArchive::DatArchiveReader reader(path, options);
+
+            const int rounds = 3;
+            auto start = Clock::now();
+            for (int round = 0; round < rounds; ++round) {
+                if (reader.getFile("input.txt").empty()) std::cout << "Failed to extract the benchmark file" << std::endl;
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            std::cout << "\t" << elapsed / rounds;
+        }
+        std::cout << std::endl;
+    }
+
+    std::filesystem::remove(inputPath);
+    std::filesystem::remove(path);
+}
+
+/**
+ * Time writing an archive of many compressed files with different numbers of threads, checking every archive is
+ * identical to the one written with a single thread
+ */
+static void benchmarkParallelWrite() {
+    std::cout << "Parallel write (ms per archive of 4096 64KiB files)" << std::endl;
+    std::cout << "threads\tms\tidentical" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-write";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-write.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    std::vector<std::string> names = generateNames(4096);
+    std::mt19937_64 random(42);
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::ofstream input(inputDirectory / std::to_string(i), std::ios::binary | std::ios::trunc);
+
+        for (uint64_t written = 0; written < 65536;) {
+            const std::string& name = names[random() % names.size()];
+            input << name << '\n';
+            written += name.size() + 1;
+        }
+    }
+
+    std::string expected;
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u}) {
+        DatArchive::WriterOptions options;
+        options.threadCount = threads;
+
+        DatArchive::DatArchiveWriter writer(options);
+        for (size_t i = 0; i < names.size(); ++i) {
+            writer.queueFile(inputDirectory / std::to_string(i),
+                             DatArchive::TableEntry(names[i], DatArchive::CompressionMethod::ZLIB, DatArchive::Flags()));
+        }
+
+        auto start = Clock::now();
+        writer.writeArchive(path, true);
+        auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::ifstream archive(path, std::ios::binary);
+        std::string written((std::istreambuf_iterator<char>(archive)), std::istreambuf_iterator<char>());
+        if (threads == 1) expected = written;
+
+        std::cout << threads << "\t" << elapsed << "\t" << (written == expected ? "yes" : "no") << std::endl;
+    }
+
+    std::filesystem::remove_all(inputDirectory);
+    std::filesystem::remove(path);
+}
+
+/**
+ * Time extracting many small compressed files, which is dominated by the cost of setting up each extraction
+ */
+static void benchmarkSmallFiles() {
+    std::cout << "Small files (us per extraction of a 1-4KiB file, reuse of cached inflate states and buffers)" << std::endl;
+    std::cout << "mode\tus\tinflater hits\tbuffer hits" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-small";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-small.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    std::vector<std::string> names = generateNames(10000);
+    std::mt19937_64 random(42);
+
+    DatArchive::DatArchiveWriter writer;
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::filesystem::path inputPath = inputDirectory / std::to_string(i);
+        {
+            std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+            uint64_t size = 1024 + random() % 3072;
+
+            for (uint64_t written = 0; written < size;) {
+                const std::string& name = names[random() % names.size()];
+                input << name << '\n';
+                written += name.size() + 1;
+            }
+        }
+
+        writer.queueFile(inputPath, DatArchive::TableEntry(names[i], DatArchive::CompressionMethod::ZLIB,
+                                                           DatArchive::Flags()));
+    }
+    writer.writeArchive(path, true);
+
+    for (auto [mode, modeName]: {std::pair{DatArchive::ReadMode::STREAM, "STREAM"},
+                                 std::pair{DatArchive::ReadMode::MAPPED, "MAPPED"},
+                                 std::pair{DatArchive::ReadMode::POSITIONAL, "POSITIONAL"}}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = mode;
+
+        DatArchive::DatArchiveReader reader(path, options);
+        DatArchive::DatArchiveReader::resetPoolStats();
+
+        const int rounds = 5;
+        auto start = Clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            for (const std::string& name: names) {
+                if (reader.getFile(name).empty()) std::cout << "Failed to extract a benchmark file" << std::endl;
+            }
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        DatArchive::PoolStats stats = DatArchive::DatArchiveReader::getPoolStats();
+        std::cout << modeName << "\t" << elapsed / (rounds * names.size()) << "\t" << stats.inflaterHits << "/"
+                  << stats.inflaterHits + stats.inflaterMisses << "\t" << stats.bufferHits << "/"
+                  << stats.bufferHits + stats.bufferMisses << std::endl;
+    }
+
+    std::filesystem::remove_all(inputDirectory);
+    std::filesystem::remove(path);
+}
+
+/**
+ * Time extracting compressed files of different sizes, inflating them in one go and in pieces
+ */
+static void benchmarkSingleShotInflate() {
+    std::cout << "Single-shot inflate (us per extraction, in pieces / in one go)" << std::endl;
+    std::cout << "size\tSTREAM\t\tPOSITIONAL" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-single";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-single.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    std::vector<std::string> names = generateNames(100000);
+    std::mt19937_64 random(42);
+
+    for (uint64_t fileSize: {1024u, 16384u, 65536u, 262144u, 1048576u}) {
+        // Roughly the same amount of data for each size, so they take about as long as each other
+        size_t fileCount = std::clamp<size_t>(67108864 / fileSize, 16, 4096);
+
+        DatArchive::DatArchiveWriter writer;
+        for (size_t i = 0; i < fileCount; ++i) {
+            std::filesystem::path inputPath = inputDirectory / std::to_string(i);
+            {
+                std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+
+                for (uint64_t written = 0; written < fileSize;) {
+                    const std::string& name = names[random() % names.size()];
+                    input << name << '\n';
+                    written += name.size() + 1;
+                }
+            }
+
+            writer.queueFile(inputPath, DatArchive::TableEntry(std::to_string(i), DatArchive::CompressionMethod::ZLIB,
+                                                               DatArchive::Flags()));
+        }
+        writer.writeArchive(path, true);
+
+        std::cout << fileSize;
+        for (DatArchive::ReadMode mode: {DatArchive::ReadMode::STREAM, DatArchive::ReadMode::POSITIONAL}) {
+            for (uint64_t limit: {(uint64_t) 0, DatArchive::ReaderOptions().singleShotInflateLimit}) {
+                DatArchive::ReaderOptions options;
+                options.readMode = mode;
+                options.singleShotInflateLimit = limit;
+
+                DatArchive::DatArchiveReader reader(path, options);
+
+                const int rounds = 3;
+                auto start = Clock::now();
+                for (int round = 0; round < rounds; ++round) {
+                    for (size_t i = 0; i < fileCount; ++i) {
+                        if (reader.getFile(std::to_string(i)).empty()) {
+                            std::cout << "Failed to extract a benchmark file" << std::endl;
+                        }
+                    }
+                }
+                auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+                std::cout << "\t" << elapsed / (rounds * fileCount);
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    std::filesystem::remove_all(inputDirectory);
+    std::filesystem::remove(path);
+}
+
+/**
+ * Compare listing a directory through the reader's listings against filtering every name from listFiles()
+ */
+static void benchmarkListing() {
+    std::cout << "Listing one of 97 directories (us per listing, 1000000 entries)" << std::endl;
+    std::cout << "version\tlistFiles\tlistDirectory\tlistDirectoryRecursive\tmatchFiles" << std::endl;
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-listing.dat";
+    std::vector<std::string> names = generateNames(1000000);
+    const std::string directory = "assets/level_5/textures/";
+
+    for (uint8_t version: {(uint8_t) 1, (uint8_t) 2}) {
+        writeTableOnlyArchive(path, names, version);
+        DatArchive::DatArchiveReader reader(path);
+
+        // The first listing of a version 1 archive sorts its names, which is left out of the timings
+        size_t expected = reader.listDirectory(directory).size();
+
+        auto timeListing = [&expected](auto list) {
+            const int rounds = 20;
+            auto start = Clock::now();
+            for (int round = 0; round < rounds; ++round) {
+                if (list() != expected) std::cout << "Listing gave the wrong number of files" << std::endl;
+            }
+            return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / rounds;
+        };
+
+        double filtered = timeListing([&reader, &directory]() {
+            size_t count = 0;
+            for (const std::string& name: reader.listFiles()) {
+                if (name.starts_with(directory)) ++count;
+            }
+            return count;
+        });
+        double listed = timeListing([&reader, &directory]() { return reader.listDirectory(directory).size(); });
+        double recursive = timeListing([&reader, &directory]() {
+            return reader.listDirectoryRecursive(directory).size();
+        });
+        double matched = timeListing([&reader, &directory]() { return reader.matchFiles(directory + "*.png").size(); });
+
+        std::cout << (int) version << "\t" << filtered << "\t\t" << listed << "\t\t" << recursive << "\t\t\t"
+                  << matched << std::endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * Compare scanning the table through getTable() against iterating over the reader's entries in place
+ */
+static void benchmarkTableIteration() {
+    std::cout << "Table scan (ms per scan summing every file's size, 1000000 entries)" << std::endl;
+    std::cout << "version\tgetTable\ttable order\tby name\tby offset" << std::endl;
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-iteration.dat";
+    std::vector<std::string> names = generateNames(1000000);
+
+    for (uint8_t version: {(uint8_t) 1, (uint8_t) 2}) {
+        writeTableOnlyArchive(path, names, version);
+        DatArchive::DatArchiveReader reader(path);
+
+        // Sorting happens on first use, which is left out of the timings
+        reader.entriesByName();
+        reader.entriesByOffset();
+
+        auto timeScan = [](auto scan) {
+            const int rounds = 5;
+            uint64_t sink = 0;
+
+            auto start = Clock::now();
+            for (int round = 0; round < rounds; ++round) sink += scan();
+            auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            // Stop the scans from being optimised away
+            if (sink == 0) std::cout << "";
+
+            return elapsed / rounds;
+        };
+
+        auto sumSizes = [](const DatArchive::EntryRange& range) {
+            uint64_t total = 0;
+            for (DatArchive::EntryView entry: range) total += entry.record().originalSize + entry.name().size();
+            return total;
+        };
+
+        double copied = timeScan([&reader]() {
+            uint64_t total = 0;
+            for (const DatArchive::TableEntry& entry: reader.getTable()) total += entry.originalSize + entry.name.size();
+            return total;
+        });
+        double inTable = timeScan([&]() { return sumSizes(reader.entriesInTableOrder()); });
+        double byName = timeScan([&]() { return sumSizes(reader.entriesByName()); });
+        double byOffset = timeScan([&]() { return sumSizes(reader.entriesByOffset()); });
+
+        std::cout << (int) version << "\t" << copied << "\t\t" << inTable << "\t\t" << byName << "\t" << byOffset
+                  << std::endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * Drop a file from the page cache, so the next reads of it come from disk
+ * @param path The file
+ */
+static void evictFromPageCache(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    // Only pages that have been written back can be dropped
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/**
+ * Find how much of a file is in the page cache
+ * @param path The file
+ * @return The fraction of the file's pages that are in the page cache
+ */
+static double residentFraction(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+
+    auto size = (size_t) std::filesystem::file_size(path);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return 0;
+
+    auto pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> resident((size + pageSize - 1) / pageSize);
+    mincore(mapping, size, resident.data());
+    munmap(mapping, size);
+
+    return (double) std::count_if(resident.begin(), resident.end(), [](unsigned char page) { return page & 1; })
+           / (double) resident.size();
+}
+
+/**
+ * Time reading an archive that isn't in the page cache with the different hints given to the kernel
+ */
+static void benchmarkReadahead() {
+    std::cout << "Readahead (reading a 128MiB archive of 64KiB stored files from disk)" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-readahead";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-readahead.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    const size_t fileCount = 2048;
+    const size_t fileSize = 65536;
+    std::mt19937_64 random(42);
+
+    std::vector<std::string> names;
+    DatArchive::DatArchiveWriter writer;
+    for (size_t i = 0; i < fileCount; ++i) {
+        std::filesystem::path inputPath = inputDirectory / std::to_string(i);
+        {
+            std::vector<uint64_t> data(fileSize / sizeof(uint64_t));
+            for (uint64_t& word: data) word = random();
+
+            std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+            input.write(reinterpret_cast<const char*>(data.data()), (std::streamsize) fileSize);
+        }
+
+        names.push_back("file_" + std::to_string(i));
+        writer.queueFile(inputPath, DatArchive::TableEntry(names.back(), DatArchive::CompressionMethod::NONE,
+                                                           DatArchive::Flags()));
+    }
+    writer.writeArchive(path, true);
+    std::filesystem::remove_all(inputDirectory);
+
+    // Every file in the order it is stored
+    std::cout << "scan\tMiB/s" << std::endl;
+    for (auto [pattern, patternName]: {std::pair{DatArchive::AccessPattern::NORMAL, "NORMAL"},
+                                       std::pair{DatArchive::AccessPattern::SEQUENTIAL, "SEQUENTIAL"},
+                                       std::pair{DatArchive::AccessPattern::RANDOM, "RANDOM"}}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = DatArchive::ReadMode::POSITIONAL;
+        options.accessPattern = pattern;
+
+        DatArchive::DatArchiveReader reader(path, options);
+        evictFromPageCache(path);
+
+        auto start = Clock::now();
+        for (const std::string& name: names) {
+            if (reader.getFile(name).size() != fileSize) std::cout << "Failed to extract a benchmark file" << std::endl;
+        }
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::cout << patternName << "\t" << (double) (fileCount * fileSize) / 1048576 / elapsed << std::endl;
+    }
+
+    // A scattered batch of files, like the assets for a level, read one at a time with and without prefetching them
+    std::vector<std::string_view> batch(names.begin(), names.end());
+    std::shuffle(batch.begin(), batch.end(), random);
+    batch.resize(256);
+
+    std::cout << "batch\tms" << std::endl;
+    for (bool prefetch: {false, true}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = DatArchive::ReadMode::POSITIONAL;
+
+        DatArchive::DatArchiveReader reader(path, options);
+        evictFromPageCache(path);
+
+        auto start = Clock::now();
+        if (prefetch) reader.prefetch(batch);
+        for (std::string_view name: batch) {
+            if (reader.getFile(name).size() != fileSize) std::cout << "Failed to extract a benchmark file" << std::endl;
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::cout << (prefetch ? "prefetch" : "none") << "\t" << elapsed << std::endl;
+    }
+
+    // How much of the archive a full scan leaves in the page cache
+    std::cout << "drop after read\tresident" << std::endl;
+    for (bool drop: {false, true}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = DatArchive::ReadMode::POSITIONAL;
+        options.dropAfterRead = drop;
+
+        DatArchive::DatArchiveReader reader(path, options);
+        evictFromPageCache(path);
+
+        for (const std::string& name: names) {
+            if (reader.getFile(name).size() != fileSize) std::cout << "Failed to extract a benchmark file" << std::endl;
+        }
+
+        std::cout << (drop ? "yes" : "no") << "\t\t" << residentFraction(path) * 100 << "%" << std::endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * Time getting the same small compressed files over and over, with and without the reader's cache
+ */
+static void benchmarkCache() {
+    std::cout << "Cache (us per file, a hot set of 2000 1-4KiB compressed files read repeatedly)" << std::endl;
+    std::cout << "cache\tgetFile\tgetFileShared\thits\tmisses\tevictions" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-cache";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-cache.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    std::vector<std::string> names = generateNames(2000);
+    std::mt19937_64 random(42);
+
+    DatArchive::DatArchiveWriter writer;
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::filesystem::path inputPath = inputDirectory / std::to_string(i);
+        {
+            std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+            uint64_t size = 1024 + random() % 3072;
+
+            for (uint64_t written = 0; written < size;) {
+                const std::string& name = names[random() % names.size()];
+                input << name << '\n';
+                written += name.size() + 1;
+            }
+        }
+
+        writer.queueFile(inputPath, DatArchive::TableEntry(names[i], DatArchive::CompressionMethod::ZLIB,
+                                                           DatArchive::Flags()));
+    }
+    writer.writeArchive(path, true);
+
+    // Every file the way it would be without a cache, to check the cached copies against
+    std::vector<std::vector<char>> expected;
+    {
+        DatArchive::DatArchiveReader reader(path);
+        for (const std::string& name: names) expected.push_back(reader.getFile(name));
+    }
+
+    // No cache, one big enough for all of the files, and one that only holds about half of them
+    for (uint64_t cacheSize: {(uint64_t) 0, (uint64_t) 67108864, (uint64_t) 4194304}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = DatArchive::ReadMode::POSITIONAL;
+        options.cacheSize = cacheSize;
+
+        DatArchive::DatArchiveReader reader(path, options);
+
+        const int rounds = 10;
+        auto start = Clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (reader.getFile(names[i]) != expected[i]) std::cout << "Cached file didn't match" << std::endl;
+            }
+        }
+        auto copied = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        start = Clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < names.size(); ++i) {
+                std::shared_ptr<const std::vector<char>> file = reader.getFileShared(names[i]);
+                if (file == nullptr || file->size() != expected[i].size()) {
+                    std::cout << "Cached file didn't match" << std::endl;
+                }
+            }
+        }
+        auto shared = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        DatArchive::CacheStats stats = reader.getCacheStats();
+        std::cout << cacheSize / 1048576 << "MiB\t" << copied / (rounds * names.size()) << "\t"
+                  << shared / (rounds * names.size()) << "\t\t" << stats.hits << "\t" << stats.misses << "\t"
+                  << stats.evictions << std::endl;
+    }
+
+    std::filesystem::remove_all(inputDirectory);
+    std::filesystem::remove(path);
+}
+
+/**
+ * A coroutine that runs as soon as it is called and cleans itself up once finished
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/**
+ * An executor that queues tasks to be run on a single thread, like a server's event loop
+ */
+class EventLoop : public DatArchive::Executor {
+    std::deque<std::function<void()>> tasks;
+    std::mutex taskMutex;
+    std::condition_variable taskAvailable;
+
+public:
+    void execute(std::function<void()> task) override {
+        {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            tasks.push_back(std::move(task));
+        }
+        taskAvailable.notify_one();
+    }
+
+    /**
+     * Run queued tasks until the condition is met
+     * @param finished Checked after each task, stops running tasks once it returns true
+     */
+    template<typename Condition>
+    void runUntil(Condition finished) {
+        while (!finished()) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(taskMutex);
+                taskAvailable.wait(lock, [this]() { return !tasks.empty(); });
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+};
+
+/**
+ * Get a file through getFileAsync() from a coroutine
+ */
+static DetachedTask retrieveFile(const DatArchive::DatArchiveReader& reader, const std::string& name,
+                                 std::vector<char>& file, DatArchive::Executor& executor, size_t& inFlight,
+                                 size_t& mostInFlight) {
+    // Everything but the read itself runs on the event loop, so the counters don't need to be locked
+    ++inFlight;
+    mostInFlight = std::max(mostInFlight, inFlight);
+
+    file = co_await reader.getFileAsync(name, &executor);
+
+    --inFlight;
+}
+
+/**
+ * Time getting many small files from coroutines all running on one event loop thread, with every file in flight at once
+ */
+static void benchmarkCoroutines() {
+    std::cout << "Coroutines (us per file, 10000 1-4KiB files started at once from one event loop thread)" << std::endl;
+    std::cout << "mode	blocking	co_await	most in flight	failures" << std::endl;
+
+    std::filesystem::path inputDirectory = std::filesystem::temp_directory_path() / "dat-archive-benchmark-coroutine";
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "dat-archive-benchmark-coroutine.dat";
+    std::filesystem::create_directories(inputDirectory);
+
+    std::vector<std::string> names = generateNames(10000);
+    std::mt19937_64 random(42);
+
+    DatArchive::DatArchiveWriter writer;
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::filesystem::path inputPath = inputDirectory / std::to_string(i);
+        {
+            std::ofstream input(inputPath, std::ios::binary | std::ios::trunc);
+            uint64_t size = 1024 + random() % 3072;
+
+            for (uint64_t written = 0; written < size;) {
+                const std::string& name = names[random() % names.size()];
+                input << name << '\n';
+                written += name.size() + 1;
+            }
+        }
+
+        // Mix stored and compressed files, so both ways through the reader are covered
+        writer.queueFile(inputPath, DatArchive::TableEntry(names[i], i % 2 == 0 ? DatArchive::CompressionMethod::ZLIB
+                                                                                 : DatArchive::CompressionMethod::NONE,
+                                                           DatArchive::Flags()));
+    }
+    writer.writeArchive(path, true);
+
+    for (auto [mode, modeName]: {std::pair{DatArchive::ReadMode::STREAM, "STREAM"},
+                                 std::pair{DatArchive::ReadMode::MAPPED, "MAPPED"},
+                                 std::pair{DatArchive::ReadMode::POSITIONAL, "POSITIONAL"}}) {
+        DatArchive::ReaderOptions options;
+        options.readMode = mode;
+
+        DatArchive::DatArchiveReader reader(path, options);
+
+        auto start = Clock::now();
+        for (const std::string& name: names) {
+            if (reader.getFile(name).empty()) std::cout << "Failed to extract a benchmark file" << std::endl;
+        }
+        auto blocking = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        EventLoop loop;
+        std::vector<std::vector<char>> files(names.size());
+        size_t inFlight = 0;
+        size_t mostInFlight = 0;
+
+        // Start every coroutine from the event loop, as a server would, before any of them can be resumed
+        start = Clock::now();
+        loop.execute([&]() {
+            for (size_t i = 0; i < names.size(); ++i) {
+                retrieveFile(reader, names[i], files[i], loop, inFlight, mostInFlight);
+            }
+        });
+        loop.runUntil([&]() { return mostInFlight > 0 && inFlight == 0; });
+        auto awaited = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        size_t failures = 0;
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (files[i].empty() || files[i] != reader.getFile(names[i])) ++failures;
+        }
+
+        std::cout << modeName << "\t" << blocking / names.size() << "\t\t" << awaited / names.size() << "\t\t"
+                  << mostInFlight << "\t\t" << failures << std::endl;
+    }
+
+    std::filesystem::remove_all(inputDirectory);
+    std::filesystem::remove(path);
+}
+
+int main() {
+    benchmarkLookup();
+    std::cout << std::endl;
+    benchmarkOpen();
+    std::cout << std::endl;
+    benchmarkListing();
+    std::cout << std::endl;
+    benchmarkTableIteration();
+    std::cout << std::endl;
+    benchmarkSmallFiles();
+    std::cout << std::endl;
+    benchmarkSingleShotInflate();
+    std::cout << std::endl;
+    benchmarkCache();
+    std::cout << std::endl;
+    benchmarkReadahead();
+    std::cout << std::endl;
+    benchmarkCoroutines();
+    std::cout << std::endl;
+    benchmarkParallelInflate();
+    std::cout << std::endl;
+    benchmarkParallelWrite();
+}
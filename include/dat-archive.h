@@ -1,26 +1,241 @@
 #pragma once
+#include <atomic>
 #include <cinttypes>
+#include <coroutine>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <map>
+#include <mutex>
+#include <span>
+#include <string_view>
 #include <vector>
 
 namespace DatArchive {
     /** The signature used by datarchive files */
     constexpr char DATFILESIGNATURE[4] = {'\xB1', '\x44', '\x41', '\x54'};
 
-    /** The version of the datarchive supported by this library */
-    constexpr uint8_t DATFILEVERSION = 0x01;
+    /** The version of the datarchive written by this library */
+    constexpr uint8_t DATFILEVERSION = 0x02;
+
+    /** The oldest version of the datarchive that can still be read by this library */
+    constexpr uint8_t DATFILEMINIMUMVERSION = 0x01;
 
     constexpr size_t CHUNKSIZE = 262144;
 
+    /** The amount of the original file held in each block of a file compressed with CompressionMethod::ZLIB_BLOCKS */
+    constexpr uint32_t ZLIBBLOCKSIZE = 1048576;
+
+    /** The size of the window deflate streams may refer back into, the most zlib allows */
+    constexpr size_t INFLATEWINDOWSIZE = 32768;
+
+    /** The largest file a DatArchiveWriter will compress into memory while writing with more than one thread */
+    constexpr uint64_t PARALLELWRITEBUFFERLIMIT = 67108864;
+
+    /** The largest gap between two files that getFiles() reads through rather than reading each file separately */
+    constexpr uint64_t COALESCEGAP = 65536;
+
+    /** The most getFiles() reads from the archive at once, files this size or larger are read on their own */
+    constexpr uint64_t COALESCELIMIT = 8388608;
+
+    /** The largest file extractAll() extracts into memory before writing it, larger files are streamed to disk */
+    constexpr uint64_t EXTRACTBUFFERLIMIT = 8388608;
+
+    /** The amount of the original file deflated by each task when WriterOptions::chunkedDeflate is set */
+    constexpr uint64_t DEFLATECHUNKSIZE = 1048576;
+
     /**
      * The compression methods available
      */
     enum class CompressionMethod : uint8_t {
         NONE,
-        ZLIB
+        ZLIB,
+        /** Independently compressed blocks followed by a table of where they end, so any part can be read directly */
+        ZLIB_BLOCKS
+    };
+
+    /**
+     * The ways a reader can access the archive file
+     */
+    enum class ReadMode : uint8_t {
+        /** Read the archive through a file stream, copying files into the given buffer */
+        STREAM,
+        /** Map the archive into memory, allowing stored files to be viewed without copying */
+        MAPPED,
+        /** Read the archive with positional reads, allowing many threads to read at once without locking */
+        POSITIONAL
+    };
+
+    /**
+     * The order files are expected to be read from an archive in, passed on to the kernel so it can read ahead to suit
+     */
+    enum class AccessPattern : uint8_t {
+        /** No particular order, the kernel reads ahead as it normally would */
+        NORMAL,
+        /** Mostly in the order they are stored, such as when scanning the whole archive, so the kernel reads further */
+        SEQUENTIAL,
+        /** No useful order, so the kernel doesn't read ahead at all */
+        RANDOM
+    };
+
+    /**
+     * Options that control how an archive is read
+     */
+    struct ReaderOptions {
+        /** How the archive file is accessed */
+        ReadMode readMode = ReadMode::STREAM;
+
+        /**
+         * Whether to cache the decoded table of version 1 archives in an index file next to the archive
+         * <br>
+         * The index file is named after the archive with ".idx" appended. It is used in place of the table while the
+         * archive's size, table offset and table checksum still match it, and is rewritten when they don't.
+         */
+        bool useIndexFile = false;
+
+        /**
+         * The distance in bytes between inflate checkpoints in compressed files, 0 to not build them automatically
+         * <br>
+         * When this is set, the first readRange() of a compressed file larger than this inflates it once and records
+         * a checkpoint about every checkpointSpacing bytes, so later range reads only inflate from the nearest
+         * checkpoint before the range instead of from the start of the file. Each checkpoint holds INFLATEWINDOWSIZE
+         * bytes.
+         */
+        uint64_t checkpointSpacing = 0;
+
+        /**
+         * The number of threads used to inflate large compressed files and check large files, 0 to use one for each core
+         * <br>
+         * With more than one thread, the checksums of large uncompressed files are calculated in slices on every thread,
+         * and files compressed with CompressionMethod::ZLIB are inflated on every thread if parallelInflate is set. With
+         * 1, everything happens on the thread that reads the file.
+         */
+        unsigned threadCount = 1;
+
+        /**
+         * Whether to split large files compressed with CompressionMethod::ZLIB up and inflate them on every thread
+         * <br>
+         * Decoding pieces of a file before the data preceding them is known costs 4 to 8 times the CPU time of zlib
+         * inflating the file alone, so this only pays off with many cores to spare. It is only used when there are at
+         * least 16 threads and as many cores, otherwise files are inflated with zlib.
+         */
+        bool parallelInflate = false;
+
+        /**
+         * The largest compressed size in bytes of a file that is read and inflated in one go, 0 to always inflate in
+         * pieces
+         * <br>
+         * When the archive isn't mapped, a compressed file this size or smaller is read from the archive with a single
+         * read and inflated straight into place with a single call to zlib. Larger files are read and inflated
+         * CHUNKSIZE bytes at a time, so the whole compressed file never has to be held in memory.
+         * <br>
+         * Files up to CHUNKSIZE are read into a buffer the thread reuses, a higher limit allocates a new buffer for
+         * each larger file.
+         */
+        uint64_t singleShotInflateLimit = CHUNKSIZE;
+
+        /**
+         * The most reads readFileAsync() keeps in flight at once through io_uring, 0 to never use io_uring
+         * <br>
+         * Where io_uring isn't available, or for files that take more than a single read, asynchronous reads are run on
+         * a pool of threads instead.
+         */
+        unsigned asyncQueueDepth = 256;
+
+        /**
+         * The most bytes of extracted files to keep in memory for reuse, 0 to not keep any
+         * <br>
+         * When this is set, files extracted from the archive are kept until the least recently used files have to make
+         * room for others, so asking for the same file again copies it instead of reading and inflating it again.
+         * getFileShared() hands out the kept copy itself, without copying it. No file larger than a sixteenth of this is
+         * kept.
+         */
+        uint64_t cacheSize = 0;
+
+        /**
+         * The order files are expected to be read in, given to the kernel when the archive is opened
+         * <br>
+         * This only affects ReadMode::MAPPED and ReadMode::POSITIONAL, the kernel can't be told how a file stream is
+         * going to be read.
+         */
+        AccessPattern accessPattern = AccessPattern::NORMAL;
+
+        /**
+         * Whether to tell the kernel it can drop a file's stored data from memory once the file has been extracted
+         * <br>
+         * This is meant for passes that read each file once, such as extractAll() on an archive larger than memory, so
+         * they don't push everything else out of the page cache. Files read again afterwards have to come from disk.
+         */
+        bool dropAfterRead = false;
+    };
+
+    /**
+     * How often readers reused an inflate state or buffer cached by the calling thread, rather than setting up a new one
+     * <br>
+     * Each thread keeps a few of each, so repeatedly extracting small compressed files doesn't initialise zlib or
+     * allocate a CHUNKSIZE buffer every time. The counts cover every reader on every thread.
+     */
+    struct PoolStats {
+        uint64_t inflaterHits = 0;
+        uint64_t inflaterMisses = 0;
+        uint64_t bufferHits = 0;
+        uint64_t bufferMisses = 0;
+    };
+
+    /**
+     * How well a reader's cache of extracted files is doing, see ReaderOptions::cacheSize
+     */
+    struct CacheStats {
+        /** The number of files found in the cache */
+        uint64_t hits = 0;
+        /** The number of files looked for in the cache but not found, so they were extracted from the archive */
+        uint64_t misses = 0;
+        /** The number of files dropped from the cache to make room for others */
+        uint64_t evictions = 0;
+        /** The number of files currently in the cache */
+        uint64_t files = 0;
+        /** The total size of the files currently in the cache */
+        uint64_t size = 0;
+    };
+
+    /**
+     * Options that control how DatArchiveReader::extractAll() extracts an archive
+     */
+    struct ExtractOptions {
+        /** The number of threads to extract files on, 0 to use one for each core */
+        unsigned threadCount = 0;
+
+        /** Whether to replace files that already exist at the destination, they are left alone otherwise */
+        bool overwrite = false;
+    };
+
+    /**
+     * Options that control how a DatArchiveWriter writes archives
+     */
+    struct WriterOptions {
+        /**
+         * The number of threads used to compress the queued files, 0 to use one for each core
+         * <br>
+         * With more than one thread, files are compressed into memory on every thread at once and written to the
+         * archive in the same order as they would be with 1, so the archive is identical either way. Files larger
+         * than PARALLELWRITEBUFFERLIMIT are compressed straight into the archive when their turn comes instead, so the
+         * memory used stays bounded.
+         */
+        unsigned threadCount = 1;
+
+        /**
+         * Whether to deflate files compressed with CompressionMethod::ZLIB in DEFLATECHUNKSIZE chunks
+         * <br>
+         * Each chunk is deflated on its own, using the 32KiB before it as a dictionary, and the chunks are joined with
+         * sync flushes into a single zlib stream, so nothing is needed to read them. This lets a single large file be
+         * compressed on every thread at once, at the cost of slightly worse compression. The archive is the same for
+         * any number of threads.
+         */
+        bool chunkedDeflate = false;
     };
 
     /**
@@ -59,60 +274,878 @@ namespace DatArchive {
         /** The offset from the beginning of the archive file immediately following the final byte of the file */
         uint64_t dataEnd = 0;
 
-        TableEntry() = default;
+        TableEntry() = default;
+
+        /**
+         *
+         * @param name The name of the file in the archive, this can include forward slashes to denote a path
+         * @param cMethod The compression method to use for the file in the archive
+         * @param flags Extra flags that may apply to the file
+         */
+        TableEntry(std::string name, CompressionMethod cMethod, Flags flags) : name(std::move(name)), compressionMethod(cMethod),
+                                                                               fileFlags(flags) {}
+
+       /**
+        * Get the size of the file inside the archive
+        * @return the size of the file inside the archive
+        */
+        [[nodiscard]] uint64_t sizeInArchive() const;
+    };
+
+    /**
+     * A compact, fixed size form of a TableEntry
+     * <br>
+     * Instead of holding its own name, the record refers to a range of a separate name arena shared by every record in
+     * the table, which keeps the memory used per entry small for very large archives.
+     * <br>
+     * This is also the layout of the entry records in a version 2 table, which lets the reader use a mapped table in
+     * place.
+     */
+    struct EntryRecord {
+        /** The original size (prior to compression) of the file */
+        uint64_t originalSize = 0;
+        /** The offset from the beginning of the archive file at which the file begins */
+        uint64_t dataStart = 0;
+        /** The offset from the beginning of the archive file immediately following the final byte of the file */
+        uint64_t dataEnd = 0;
+        /** The offset of the name of the file in the name arena */
+        uint64_t nameOffset = 0;
+        /** The CRC32 checksum for the file in the archive */
+        uint32_t crc32 = 0;
+        /** The length of the name of the file */
+        uint16_t nameLength = 0;
+        /** The compression method used for the file */
+        CompressionMethod compressionMethod = CompressionMethod::NONE;
+        /** Extra flags that apply to the file, as stored in the archive */
+        uint8_t fileFlags = 0;
+
+        /**
+         * Get the size of the file inside the archive
+         * @return the size of the file inside the archive
+         */
+        [[nodiscard]] uint64_t sizeInArchive() const;
+
+        /**
+         * Get the name of the file from the name arena
+         * @param nameArena The name arena the record refers to
+         * @return The name of the file
+         */
+        [[nodiscard]] std::string_view name(std::string_view nameArena) const;
+
+        /**
+         * Expand the record into a full TableEntry
+         * @param nameArena The name arena the record refers to
+         * @return The TableEntry represented by the record
+         */
+        [[nodiscard]] TableEntry toTableEntry(std::string_view nameArena) const;
+    };
+
+    static_assert(sizeof(EntryRecord) == 40, "EntryRecord is expected to be 40 bytes");
+
+    /**
+     * A view of an entry in a reader's table, without copying it out
+     * <br>
+     * The view refers to the reader's own storage, so it is only valid until the archive is closed.
+     */
+    class EntryView {
+        const EntryRecord* entry = nullptr;
+        std::string_view nameArena;
+
+    public:
+        EntryView() = default;
+
+        /**
+         * @param entry The entry
+         * @param nameArena The name arena the entry refers to
+         */
+        EntryView(const EntryRecord& entry, std::string_view nameArena);
+
+        /**
+         * Get the name of the file
+         * @return The name of the file
+         */
+        [[nodiscard]] std::string_view name() const;
+
+        /**
+         * Get the entry as it is stored in the table
+         * @return The entry, which refers to the name arena for its name
+         */
+        [[nodiscard]] const EntryRecord& record() const;
+
+        /**
+         * Copy the entry out into a full TableEntry
+         * @return The TableEntry represented by the entry
+         */
+        [[nodiscard]] TableEntry toTableEntry() const;
+    };
+
+    /**
+     * The entries of a reader's table in a particular order, which can be iterated without copying anything
+     * <br>
+     * The range refers to the reader's own storage, so it is only valid until the archive is closed.
+     */
+    class EntryRange {
+        std::span<const EntryRecord> entries;
+        std::string_view nameArena;
+        /** The positions of the entries in the order they are visited, nullptr for the order they are stored in */
+        const size_t* order = nullptr;
+
+    public:
+        /**
+         * Iterates over the entries of a range, giving an EntryView of each
+         */
+        class Iterator {
+            const EntryRange* range = nullptr;
+            size_t position = 0;
+
+        public:
+            using iterator_concept = std::forward_iterator_tag;
+            using value_type = EntryView;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+
+            Iterator(const EntryRange& range, size_t position) : range(&range), position(position) {}
+
+            EntryView operator*() const {
+                return (*range)[position];
+            }
+
+            Iterator& operator++() {
+                ++position;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator previous = *this;
+                ++position;
+                return previous;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return position == other.position;
+            }
+        };
+
+        EntryRange() = default;
+
+        /**
+         * @param entries The entries
+         * @param nameArena The name arena the entries refer to
+         * @param order The positions of the entries in the order they should be visited, nullptr to visit them in the
+         * order they are stored in. This must hold a position for every entry.
+         */
+        EntryRange(std::span<const EntryRecord> entries, std::string_view nameArena, const size_t* order);
+
+        [[nodiscard]] Iterator begin() const;
+
+        [[nodiscard]] Iterator end() const;
+
+        /**
+         * Get the number of entries in the range
+         * @return The number of entries
+         */
+        [[nodiscard]] size_t size() const;
+
+        /**
+         * Check whether the range has no entries
+         * @return true if there are no entries
+         */
+        [[nodiscard]] bool empty() const;
+
+        /**
+         * Get an entry by its position in the range
+         * @param position The position, which must be less than size()
+         * @return The entry
+         */
+        EntryView operator[](size_t position) const;
+    };
+
+    /**
+     * An open addressing hash index for looking up entries in a file table by name
+     * <br>
+     * The index only stores the position of each entry in the table, the names themselves are fetched from the table
+     * through the nameOf function given to build() and find(), which must take a position and return the name of the
+     * entry at that position as something comparable with a std::string_view.
+     */
+    class EntryIndex {
+    public:
+        /** The value returned by find() when there is no entry with the given name */
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+        /**
+         * A slot in the index
+         */
+        struct Slot {
+            /** The upper half of the hash of the entry's name, used to skip most mismatches without comparing names */
+            uint32_t hashTag = 0;
+            /** The position of the entry in the table plus one, 0 if the slot is empty */
+            uint32_t entry = 0;
+        };
+
+    private:
+        std::vector<Slot> slotStorage;
+        std::span<const Slot> slots;
+        size_t entryCount = 0;
+
+    public:
+        EntryIndex() = default;
+
+        // The slots may be a view of the index's own storage, which a copy would not share
+        EntryIndex(const EntryIndex&) = delete;
+        EntryIndex& operator=(const EntryIndex&) = delete;
+        EntryIndex(EntryIndex&&) = default;
+        EntryIndex& operator=(EntryIndex&&) = default;
+
+        /**
+         * Hash a name for use in the index
+         * @param name The name to hash
+         * @return The hash of the name
+         */
+        static uint64_t hashName(std::string_view name);
+
+        /**
+         * Build the index for a table, replacing any existing index
+         * <br>
+         * If multiple entries share a name, only the first is indexed
+         * @param entryCount The number of entries in the table
+         * @param nameOf A function that returns the name of the entry at the given position in the table
+         */
+        template<typename NameOf>
+        void build(size_t entryCount, NameOf nameOf) {
+            // Keep the load factor at or below one half so probe sequences stay short
+            size_t capacity = 8;
+            while (capacity < entryCount * 2) capacity *= 2;
+
+            slotStorage.assign(capacity, {});
+            const size_t mask = capacity - 1;
+
+            for (size_t position = 0; position < entryCount; ++position) {
+                auto name = nameOf(position);
+                uint64_t hash = hashName(name);
+                uint32_t hashTag = hash >> 32;
+
+                size_t i = hash & mask;
+                while (slotStorage[i].entry != 0) {
+                    if (slotStorage[i].hashTag == hashTag && nameOf(slotStorage[i].entry - 1) == name) break;
+                    i = (i + 1) & mask;
+                }
+
+                if (slotStorage[i].entry == 0) slotStorage[i] = {hashTag, (uint32_t) (position + 1)};
+            }
+
+            slots = slotStorage;
+            this->entryCount = entryCount;
+        }
+
+        /**
+         * Use slots built by a previous index, such as ones loaded from an index file, without copying them
+         * <br>
+         * The slots must outlive the index. They are checked before being used, so every probe still ends at an empty
+         * slot and never leaves the table.
+         * @param builtSlots The slots of the previous index
+         * @param entryCount The number of entries in the table the slots were built for
+         * @return true if the slots are usable, false if they can't have come from an index
+         */
+        bool adopt(std::span<const Slot> builtSlots, size_t entryCount);
+
+        /**
+         * Get the slots of the index, so they can be saved and adopted later
+         * @return The slots of the index
+         */
+        [[nodiscard]] std::span<const Slot> getSlots() const;
+
+        /**
+         * Find the position of an entry in the table
+         * @param name The name of the entry
+         * @param nameOf A function that returns the name of the entry at the given position in the table
+         * @return The position of the entry in the table, NOT_FOUND if there isn't one
+         */
+        template<typename NameOf>
+        [[nodiscard]] size_t find(std::string_view name, NameOf nameOf) const {
+            if (slots.empty()) return NOT_FOUND;
+
+            uint64_t hash = hashName(name);
+            uint32_t hashTag = hash >> 32;
+            const size_t mask = slots.size() - 1;
+
+            for (size_t i = hash & mask; slots[i].entry != 0; i = (i + 1) & mask) {
+                if (slots[i].hashTag == hashTag && nameOf(slots[i].entry - 1) == name) return slots[i].entry - 1;
+            }
+
+            return NOT_FOUND;
+        }
+
+        /**
+         * Remove everything from the index
+         */
+        void clear();
+    };
+
+    /**
+     * A point inside a zlib compressed file that inflating can resume from without starting at the beginning of it
+     */
+    struct InflateCheckpoint {
+        /** The number of bytes of the compressed file that have been consumed by this point */
+        uint64_t compressedOffset = 0;
+        /** The offset into the original file that inflating resumes at */
+        uint64_t originalOffset = 0;
+        /** The number of bits of the last consumed byte that haven't been used yet, from 0 to 7 */
+        uint8_t bits = 0;
+        /** The INFLATEWINDOWSIZE bytes of the original file preceding originalOffset, which later data may refer to */
+        std::vector<unsigned char> window;
+    };
+
+    /**
+     * Something directly inside a directory of an archive, listed by DatArchiveReader::listDirectory()
+     * <br>
+     * Names in an archive use '/' to separate directories. Directories aren't stored themselves, they only exist as the
+     * start of the names of the files inside them.
+     */
+    struct DirectoryEntry {
+        /** The full name of the file, or of the directory including its trailing '/', viewed inside the reader */
+        std::string_view name;
+        /** Whether this is a directory, rather than a file */
+        bool directory = false;
+    };
+
+    class DatArchiveReader;
+
+    class ThreadPool;
+
+    class UringReader;
+
+    class EntryCache;
+
+    /**
+     * Somewhere to resume coroutines waiting on the reader, such as the event loop they were running on
+     */
+    class Executor {
+    public:
+        virtual ~Executor() = default;
+
+        /**
+         * Run a task, the task may be run on any thread and at any point after this is called, but must be run exactly
+         * once
+         * @param task The task to run
+         */
+        virtual void execute(std::function<void()> task) = 0;
+    };
+
+    /**
+     * Something from the reader that can be waited on with co_await, returned by DatArchiveReader::getFileAsync() and
+     * DatArchiveReader::getFileRawAsync()
+     * <br>
+     * The work isn't started until the awaitable is awaited, and it must only be awaited once.
+     * @tparam Result The type co_await gives back
+     */
+    template<typename Result>
+    class ReadAwaitable {
+    public:
+        /** Starts the work, which must call the callback it is given exactly once with the result */
+        using Start = std::function<void(std::function<void(Result)>)>;
+
+    private:
+        Start start;
+        Executor* executor;
+        Result result{};
+        // Set by whichever of await_suspend() and the callback gets there first, the other resumes the coroutine
+        std::atomic<bool> arrived = false;
+
+    public:
+        /**
+         * @param start Starts the work
+         * @param executor Where to resume the awaiting coroutine, nullptr to resume it on whichever thread finishes
+         * the work
+         */
+        ReadAwaitable(Start start, Executor* executor) : start(std::move(start)), executor(executor) {}
+
+        ReadAwaitable(ReadAwaitable&& other) noexcept : start(std::move(other.start)), executor(other.executor) {}
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            // The coroutine may be resumed, and this destroyed, as soon as either side has marked its arrival, so
+            // neither touches this afterwards
+            Start begin = std::move(start);
+            begin([this, handle, executor = executor](Result finished) {
+                result = std::move(finished);
+                if (!arrived.exchange(true, std::memory_order_acq_rel)) return;
+
+                if (executor != nullptr) executor->execute([handle]() { handle.resume(); });
+                else handle.resume();
+            });
+
+            // When the work finished before start() returned, the coroutine carries on here instead of being resumed
+            // from inside the callback, which would nest a frame for every file awaited that way
+            return !arrived.exchange(true, std::memory_order_acq_rel);
+        }
+
+        Result await_resume() {
+            return std::move(result);
+        }
+    };
+
+    /**
+     * A single file being read out of an archive a piece at a time
+     * <br>
+     * Compressed files are inflated as they are read, so only a CHUNKSIZE buffer is held regardless of the size of the
+     * file. The CRC is calculated as the file is read and checked once the end of the file is reached, which is reported
+     * through getState().
+     * <br>
+     * The reader the stream was opened from must outlive the stream. A single stream must only be used by one thread at
+     * a time, but any number of streams can be read from the same reader at once.
+     */
+    class EntryStream {
+    public:
+        /**
+         * The states an entry stream can be in
+         */
+        enum class State : uint8_t {
+            /** There is more of the file left to read */
+            READING,
+            /** The whole file has been read and its CRC matched, or wasn't checked */
+            FINISHED,
+            /** The whole file has been read but its CRC didn't match */
+            CRC_MISMATCH,
+            /** The file couldn't be read, either it doesn't exist or the archive is damaged */
+            FAILED
+        };
+
+    private:
+        /** The zlib state, kept out of this header */
+        struct Inflater;
+
+        const DatArchiveReader* reader = nullptr;
+        EntryRecord entry;
+        bool validateCrc = true;
+
+        State state = State::FAILED;
+        uint64_t position = 0;
+        uint64_t produced = 0;
+        uint32_t calculatedCrc = 0;
+
+        std::unique_ptr<Inflater> inflater;
+
+        /**
+         * Read the next piece of the file from the archive into the inflater's input buffer
+         * @return True if successful
+         */
+        bool refillInput();
+
+        /**
+         * Check the CRC and size of the file once the end has been reached, and update the state to match
+         */
+        void finish();
+
+        /**
+         * Jump straight to the start of the block holding the given offset, for files compressed with
+         * CompressionMethod::ZLIB_BLOCKS
+         * <br>
+         * Nothing happens if the offset is in the current block, or the block table can't be read
+         * @param target The offset into the original file to move towards
+         */
+        void seekBlock(uint64_t target);
+
+        friend class DatArchiveReader;
+
+        /**
+         * Start streaming a file
+         * @param reader The reader that holds the file
+         * @param entry The entry for the file
+         * @param validateCrc Whether to validate the CRC of the file
+         */
+        EntryStream(const DatArchiveReader& reader, const EntryRecord& entry, bool validateCrc);
+
+        /**
+         * Start streaming a compressed file from a checkpoint part way through it
+         * <br>
+         * The start of the file is never seen, so its CRC isn't validated
+         * @param reader The reader that holds the file
+         * @param entry The entry for the file
+         * @param checkpoint The checkpoint to start from
+         */
+        EntryStream(const DatArchiveReader& reader, const EntryRecord& entry, const InflateCheckpoint& checkpoint);
+
+    public:
+        /**
+         * Create a stream that has already failed, as returned when a file doesn't exist
+         */
+        EntryStream();
+
+        EntryStream(EntryStream&& other) noexcept;
+
+        EntryStream& operator=(EntryStream&& other) noexcept;
+
+        ~EntryStream();
+
+        /**
+         * Read the next part of the file
+         * @param buffer The buffer to read into
+         * @param size The maximum number of bytes to read
+         * @return The number of bytes read, 0 once the end of the file has been reached or if the stream has failed
+         */
+        size_t read(char* buffer, size_t size);
+
+        /**
+         * Move forward through the file without keeping what is skipped
+         * <br>
+         * Compressed files still have to be inflated up to the new position. Skipping any of the file means its CRC
+         * can no longer be validated, so the stream will finish without checking it.
+         * @param count The number of bytes to skip
+         * @return The number of bytes skipped, less than count if the end of the file was reached or the stream failed
+         */
+        uint64_t skip(uint64_t count);
+
+        /**
+         * Get the state of the stream
+         * @return The state of the stream
+         */
+        [[nodiscard]] State getState() const;
+
+        /**
+         * Check if the stream is still usable, that is, it hasn't failed or found a CRC mismatch
+         * @return true if the stream is still usable
+         */
+        [[nodiscard]] bool good() const;
+
+        /**
+         * Get the original size of the file being streamed
+         * @return The original size of the file
+         */
+        [[nodiscard]] uint64_t size() const;
+
+        /**
+         * Get the number of bytes of the file that have been read so far
+         * @return The number of bytes read so far
+         */
+        [[nodiscard]] uint64_t tell() const;
+    };
+
+    /**
+     * A std::streambuf that reads from an EntryStream, so a file in an archive can be used with a std::istream
+     * <br>
+     * Once the std::istream reaches the end of the file, the CRC can be checked through stream().getState()
+     */
+    class EntryStreambuf : public std::streambuf {
+        EntryStream entryStream;
+        std::unique_ptr<char[]> buffer;
+
+    protected:
+        int_type underflow() override;
+
+    public:
+        /**
+         * @param entryStream The stream of the file to read from
+         */
+        explicit EntryStreambuf(EntryStream entryStream);
+
+        /**
+         * Get the stream being read from
+         * @return The stream being read from
+         */
+        [[nodiscard]] const EntryStream& stream() const;
+    };
+
+    /**
+     * A class for reading DatArchive Files
+     * <br>
+     * Once an archive has been opened, the functions used to read files from it are safe to call from multiple threads
+     * at once. With ReadMode::STREAM those reads take turns on the single file stream, the other read modes do not
+     * need to lock.
+     */
+    class DatArchiveReader {
+        // Operational data
+        std::filesystem::path archivePath;
+        mutable std::ifstream archive;
+        ReaderOptions options;
+
+        // Guards the position of the archive stream, only used with ReadMode::STREAM
+        mutable std::mutex archiveMutex;
+
+        // File descriptor, only used with ReadMode::POSITIONAL
+        int archiveDescriptor = -1;
+
+        // File descriptor only used to give the kernel hints about the archive, when there isn't an archiveDescriptor
+        int hintDescriptor = -1;
+
+        // Memory mapping, only used with ReadMode::MAPPED
+        const std::byte* mappedArchive = nullptr;
+        uint64_t mappedSize = 0;
+
+        // Memory mapping of just the table, used for version 2 archives when the whole archive isn't mapped
+        const std::byte* mappedTable = nullptr;
+        uint64_t mappedTableSize = 0;
+
+        // Memory mapping of the index file, only used with ReaderOptions::useIndexFile
+        const std::byte* mappedIndex = nullptr;
+        uint64_t mappedIndexSize = 0;
+
+        // Archive file metadata
+        uint8_t archiveVersion{};
+        uint64_t archiveSize{};
+        uint64_t tableOffset{};
+
+        // The table, either decoded into the storage below or viewed in place inside a mapping
+        std::span<const EntryRecord> entries;
+        std::string_view nameArena;
+        std::vector<EntryRecord> entryStorage;
+        std::string nameStorage;
+
+        // Tables sorted by name are binary searched, anything else is looked up through the index
+        bool sortedTable = false;
+        EntryIndex entryIndex;
+
+        // The positions of the entries in name order, only built for tables that aren't sorted, once a listing needs it
+        mutable std::mutex orderMutex;
+        mutable std::vector<size_t> nameOrder;
+        mutable std::atomic<bool> nameOrderBuilt = false;
+
+        // The positions of the entries in the order their data is stored, built the first time it is needed
+        mutable std::vector<size_t> dataOrder;
+        mutable std::atomic<bool> dataOrderBuilt = false;
+
+        // Threads for inflating large files, only used when ReaderOptions::threadCount isn't 1
+        std::unique_ptr<ThreadPool> threadPool;
+        // Whether large ZLIB files are inflated on the pool, only when asked for and there are enough cores to win
+        bool inflateInParallel = false;
+
+        // Asynchronous reads, only started once readFileAsync() is first used
+        mutable std::mutex asyncMutex;
+        mutable std::unique_ptr<UringReader> uringReader;
+        mutable std::unique_ptr<ThreadPool> asyncPool;
+
+        // Extracted files kept for reuse, only created when ReaderOptions::cacheSize is set
+        std::unique_ptr<EntryCache> cache;
+
+        // Inflate checkpoints of compressed files, keyed by the start of the file's data
+        mutable std::mutex checkpointMutex;
+        mutable std::map<uint64_t, std::shared_ptr<const std::vector<InflateCheckpoint>>> checkpoints;
+
+        // Flags
+        bool openFlag = false;
+        mutable std::atomic<bool> badFlag = false;
+
+        friend class EntryStream;
+
+        /**
+         * Check the archive is valid
+         * @param signature The signature of the archive being checked
+         * @param version The version of the archive being checked
+         * @return
+         */
+        static bool validateArchive(char* signature, uint8_t version);
+
+        /**
+         * Load the table of the archive
+         * <br>
+         * Version 1 tables are read in a single read, then decoded with parseTable(). Version 2 tables are mapped and
+         * used in place with loadSortedTable().
+         * @return True if successful
+         */
+        bool loadTable();
+
+        /**
+         * Decode a version 1 table from memory
+         * @param table The table, as it is stored in the archive
+         * @param tableSize The size of the table in bytes
+         * @return True if successful, false if the table is malformed
+         */
+        bool parseTable(const char* table, uint64_t tableSize);
+
+        /**
+         * Use a version 2 table that has been mapped into memory
+         * <br>
+         * This only checks that the records and name heap fit inside the table, so it takes the same time regardless
+         * of the number of entries.
+         * @param table The table, as it is stored in the archive
+         * @param tableSize The size of the table in bytes
+         * @return True if successful, false if the table is malformed
+         */
+        bool loadSortedTable(const char* table, uint64_t tableSize);
+
+        /**
+         * Map the table region of the archive file into memory
+         * @return True if successful
+         */
+        bool mapTable();
+
+        /**
+         * Get the path of the index file for the archive
+         * @return The path of the index file
+         */
+        std::filesystem::path indexFilePath() const;
+
+        /**
+         * Use the table stored in the archive's index file, if it still matches the archive
+         * @param tableCrc The CRC32 checksum of the archive's table
+         * @return True if the index file was used, false if it is missing, stale or malformed
+         */
+        bool loadIndexFile(uint32_t tableCrc);
+
+        /**
+         * Save the loaded table and its index to the archive's index file
+         * @param tableCrc The CRC32 checksum of the archive's table
+         * @return True if successful
+         */
+        bool writeIndexFile(uint32_t tableCrc) const;
+
+        /**
+         * Map the whole archive file into memory
+         * @return True if successful
+         */
+        bool mapArchive();
+
+        /**
+         * Release the memory mappings of the archive, its table and its index file, if there are any
+         */
+        void unmapArchive();
+
+        /**
+         * Read a region of the archive using whichever method the archive was opened with
+         * <br>
+         * This is safe to call from multiple threads at once
+         * @param offset The offset from the beginning of the archive file to start reading from
+         * @param buffer The buffer to read into
+         * @param size The number of bytes to read
+         * @return True if all the bytes were read
+         */
+        bool readFromArchive(uint64_t offset, char* buffer, uint64_t size) const;
+
+        /**
+         * Find the entry for a file
+         * @param name The name of the file
+         * @return The entry for the file, nullptr if the file isn't in the archive
+         */
+        const EntryRecord* findEntry(std::string_view name) const;
+
+        /**
+         * Make sure the entries can be visited in name order, sorting them if the table isn't already sorted
+         */
+        void buildNameOrder() const;
+
+        /**
+         * Make sure the entries can be visited in the order their data is stored, sorting them if needed
+         */
+        void buildDataOrder() const;
+
+        /**
+         * Get the name of an entry by its position in name order, buildNameOrder() must have been called
+         * @param position The position of the entry when sorted by name
+         * @return The name of the entry
+         */
+        std::string_view nameInOrder(size_t position) const;
+
+        /**
+         * Find the entries whose names start with a prefix, buildNameOrder() must have been called
+         * @param prefix The prefix
+         * @return The range of positions in name order holding the entries, the first position and one past the last
+         */
+        std::pair<size_t, size_t> prefixRange(std::string_view prefix) const;
 
         /**
-         *
-         * @param name The name of the file in the archive, this can include forward slashes to denote a path
-         * @param cMethod The compression method to use for the file in the archive
-         * @param flags Extra flags that may apply to the file
+         * Retrieve a file from the archive using it's entry
+         * <br>
+         * The file is copied out of the cache if it is there, otherwise it is extracted and added to the cache.
+         * @param entry The entry for the file
+         * @param buffer The buffer to write the file into
+         * @param validateCrc Whether to validate the CRC or the file
+         * @return The size of the file
          */
-        TableEntry(std::string name, CompressionMethod cMethod, Flags flags) : name(std::move(name)), compressionMethod(cMethod),
-                                                                               fileFlags(flags) {}
+        uint64_t getFileFromEntry(const EntryRecord& entry, char* buffer, bool validateCrc = true) const;
 
-       /**
-        * Get the size of the file inside the archive
-        * @return the size of the file inside the archive
-        */
-        [[nodiscard]] uint64_t sizeInArchive() const;
-    };
+        /**
+         * Extract a file from the archive using it's entry, without going through the cache
+         * @param entry The entry for the file
+         * @param buffer The buffer to write the file into
+         * @param validateCrc Whether to validate the CRC or the file
+         * @return The size of the file
+         */
+        uint64_t extractFromEntry(const EntryRecord& entry, char* buffer, bool validateCrc) const;
 
-    class DatArchiveReader {
-        // Operational data
-        std::filesystem::path archivePath;
-        std::ifstream archive;
+        /**
+         * Hints that can be given to the kernel about part of the archive
+         */
+        enum class Advice : uint8_t {
+            NORMAL,
+            SEQUENTIAL,
+            RANDOM,
+            /** The data will be needed soon, so the kernel should start reading it now */
+            WILLNEED,
+            /** The data won't be needed again, so the kernel can drop it from memory */
+            DONTNEED
+        };
 
-        // Archive file metadata
-        uint8_t archiveVersion{};
-        uint64_t tableOffset{};
-        std::map<std::string, TableEntry> entries;
+        /**
+         * Give the kernel a hint about part of the archive, hints are only ever advice so failures are ignored
+         * @param offset The start of the part of the archive
+         * @param size The size of the part of the archive, 0 for everything after offset
+         * @param advice The hint
+         */
+        void adviseRange(uint64_t offset, uint64_t size, Advice advice) const;
 
-        // Flags
-        bool openFlag = false;
-        bool badFlag = false;
+        /**
+         * Tell the kernel the stored data of several files will be needed soon
+         * <br>
+         * Files stored within COALESCEGAP of each other are given as a single range.
+         * @param sorted The entries for the files, in the order their data is stored
+         */
+        void adviseWillNeed(std::span<const EntryRecord* const> sorted) const;
 
         /**
-         * Check the archive is valid
-         * @param signature The signature of the archive being checked
-         * @param version The version of the archive being checked
-         * @return
+         * Copy a file out of the cache
+         * @param entry The entry for the file
+         * @param buffer The buffer to write the file into
+         * @return The size of the file, 0 if there is no cache or the file isn't in it
          */
-        static bool validateArchive(char* signature, uint8_t version);
+        uint64_t getFileFromCache(const EntryRecord& entry, char* buffer) const;
 
         /**
-         * Load the table of the archive
-         * @return True if successful
+         * Add a copy of an extracted file to the cache, if there is one and the file fits
+         * @param entry The entry for the file
+         * @param file The extracted file, which must have had its CRC validated
+         * @param size The size of the file
          */
-        bool loadTable();
+        void addFileToCache(const EntryRecord& entry, const char* file, uint64_t size) const;
 
         /**
-         * Retrieve a file from the archive using it's entry
+         * Retrieve several files from the archive, reading them in the order they are stored
+         * <br>
+         * Files that are stored close together are read with a single read, up to COALESCELIMIT bytes at a time, then
+         * decoded from memory.
+         * @param entries The entries for the files, nullptr for files that weren't found
+         * @param buffers The buffers to write each file into
+         * @return The size of each file, 0 for files that couldn't be retrieved
+         */
+        std::vector<uint64_t> getFilesFromEntries(std::span<const EntryRecord* const> entries,
+                                                  std::span<char* const> buffers) const;
+
+        /**
+         * Retrieve a file from the archive using it's entry, when its stored data has already been read into memory
          * @param entry The entry for the file
+         * @param source The stored data of the file, entry.sizeInArchive() bytes long
          * @param buffer The buffer to write the file into
-         * @param validateCrc Whether to validate the CRC or the file
          * @return The size of the file
          */
-        uint64_t getFileFromEntry(const TableEntry& entry, char* buffer, bool validateCrc = true);
+        uint64_t getFileFromMemory(const EntryRecord& entry, const unsigned char* source, char* buffer) const;
+
+        /**
+         * Extract a file from the archive into a new file on disk
+         * @param entry The entry for the file
+         * @param destination The path to write the file to, its directory must already exist
+         * @param overwrite Whether to replace the file if it already exists
+         * @return true if the file was extracted or already existed and wasn't replaced
+         */
+        bool extractEntry(const EntryRecord& entry, const std::filesystem::path& destination, bool overwrite) const;
+
+        /**
+         * Start the io_uring reader and the pool of threads used for asynchronous reads, if they haven't been already
+         * @param uring Set to the io_uring reader, nullptr if io_uring isn't being used
+         * @param pool Set to the pool of threads
+         */
+        void startAsyncReads(UringReader*& uring, ThreadPool*& pool) const;
 
         /**
          * Extract an uncompressed file from the archive using it's entry
@@ -121,7 +1154,7 @@ namespace DatArchive {
          * @param validateCrc Whether to validate the CRC or the file
          * @return The size of the file
          */
-        uint64_t extractFile(const TableEntry& entry, char* buffer, bool validateCrc);
+        uint64_t extractFile(const EntryRecord& entry, char* buffer, bool validateCrc) const;
 
         /**
          * Extract a compressed file from the archive using it's entry
@@ -130,17 +1163,85 @@ namespace DatArchive {
          * @param validateCrc Whether to validate the CRC or the file
          * @return The size of the file
          */
-        uint64_t zlibExtractFile(const TableEntry& entry, char* buffer, bool validateCrc);
+        uint64_t zlibExtractFile(const EntryRecord& entry, char* buffer, bool validateCrc) const;
+
+        /**
+         * Extract a compressed file from the archive using every thread of the thread pool
+         * @param entry The entry for the file
+         * @param buffer The buffer to write the file into
+         * @param validateCrc Whether to validate the CRC or the file
+         * @param size Set to the size of the file, or 0 if it failed its CRC check
+         * @return True if the file was inflated, false if it has to be inflated on a single thread instead
+         */
+        bool parallelZlibExtractFile(const EntryRecord& entry, char* buffer, bool validateCrc, uint64_t& size) const;
+
+        /**
+         * Extract a file compressed in blocks from the archive using it's entry
+         * @param entry The entry for the file
+         * @param buffer The buffer to write the file into
+         * @param validateCrc Whether to validate the CRC or the file
+         * @return The size of the file
+         */
+        uint64_t zlibBlocksExtractFile(const EntryRecord& entry, char* buffer, bool validateCrc) const;
+
+        /**
+         * Read the block table of a file compressed with CompressionMethod::ZLIB_BLOCKS
+         * @param entry The entry for the file
+         * @param blockEnds Set to the offset from the start of the file's data of the end of each block
+         * @param blockSize Set to the amount of the original file held in each block
+         * @return True if successful, false if the table couldn't be read or doesn't match the entry
+         */
+        bool readBlockTable(const EntryRecord& entry, std::vector<uint64_t>& blockEnds, uint32_t& blockSize) const;
+
+        /**
+         * Calculate the CRC32 checksum of some data, on every thread of the pool if there is one and the data is large
+         * @param data The data
+         * @param size The size of the data in bytes
+         * @return The checksum of the data
+         */
+        uint32_t calculateCrc(const unsigned char* data, uint64_t size) const;
+
+        /**
+         * Inflate a compressed file that is already in memory
+         * @param entry The entry for the file
+         * @param source The compressed file, must be at least entry.sizeInArchive() bytes long
+         * @param buffer The buffer to write the file into
+         * @param validateCrc Whether to validate the CRC or the file
+         * @return The size of the file
+         */
+        static uint64_t zlibInflateBuffer(const EntryRecord& entry, const unsigned char* source, char* buffer,
+                                          bool validateCrc);
+
+        /**
+         * Get the inflate checkpoints that have been built or loaded for a file
+         * @param entry The entry for the file
+         * @return The checkpoints for the file, nullptr if there aren't any
+         */
+        std::shared_ptr<const std::vector<InflateCheckpoint>> findCheckpoints(const EntryRecord& entry) const;
+
+        /**
+         * Inflate a compressed file once, recording a checkpoint at the first block boundary after every spacing bytes
+         * <br>
+         * The whole file is read, so its CRC is validated and no checkpoints are kept for a damaged file
+         * @param entry The entry for the file
+         * @param spacing The minimum distance in bytes between checkpoints
+         * @return The checkpoints for the file, nullptr if it couldn't be inflated
+         */
+        std::shared_ptr<const std::vector<InflateCheckpoint>> buildCheckpoints(const EntryRecord& entry,
+                                                                               uint64_t spacing) const;
 
     public:
-        DatArchiveReader(const std::filesystem::path& archiveFilePath);
+        DatArchiveReader(const std::filesystem::path& archiveFilePath, ReaderOptions options = {});
+
+        ~DatArchiveReader();
 
         /**
          * Open an archive
          * @param archiveFilePath The path to the archive
+         * @param options Options controlling how the archive is read
          * @return true if successful
          */
-        bool openArchive(const std::filesystem::path& archiveFilePath);
+        bool openArchive(const std::filesystem::path& archiveFilePath, ReaderOptions options = {});
 
         /**
          * Close the archive
@@ -154,20 +1255,60 @@ namespace DatArchive {
          */
         size_t size() const;
 
-        bool contains(const std::string& name) const;
+        /**
+         * Check if the archive contains a file
+         * @param name The name of the file
+         * @return true if the file is in the archive
+         */
+        bool contains(std::string_view name) const;
 
         /**
-         * Get a list of all the file names in the archive
-         * @returna list of all the file names in the archive
+         * Get a list of all the file names in the archive, in the order they appear in the table
+         * @return a list of all the file names in the archive
          */
         std::vector<std::string> listFiles() const;
 
+        /**
+         * List the files and directories directly inside a directory of the archive, in name order
+         * <br>
+         * The names are views into the reader, which stay valid until the archive is closed. Each subdirectory is
+         * skipped over as a whole, so this takes time proportional to the size of the listing rather than the number of
+         * files below the directory.
+         * @param directory The directory, with or without a trailing '/', or empty for the top of the archive
+         * @return The files and directories inside the directory, empty if there are none
+         */
+        std::vector<DirectoryEntry> listDirectory(std::string_view directory) const;
+
+        /**
+         * List every file inside a directory of the archive, including those in its subdirectories, in name order
+         * <br>
+         * The names are views into the reader, which stay valid until the archive is closed.
+         * @param directory The directory, with or without a trailing '/', or empty for the whole archive
+         * @return The full names of the files
+         */
+        std::vector<std::string_view> listDirectoryRecursive(std::string_view directory) const;
+
+        /**
+         * List the files in the archive whose names match a glob pattern, in name order
+         * <br>
+         * '*' matches any characters apart from '/', and "**" matches any characters including '/', where "**"
+         * followed by '/' can also match no directories at all. '?' matches any single character apart from '/', and
+         * "[...]" matches one of the characters or ranges of characters inside it, or any other character if it starts
+         * with '!' or '^'. A backslash matches the character after it exactly.
+         * <br>
+         * Only files whose names start with the part of the pattern before its first wildcard are looked at. The names
+         * are views into the reader, which stay valid until the archive is closed.
+         * @param pattern The pattern
+         * @return The full names of the matching files
+         */
+        std::vector<std::string_view> matchFiles(std::string_view pattern) const;
+
         /**
          * Get a specific file from the archive
          * @param name The name of the file
          * @return A byte vector that represents the file, empty if the file doesn't exist
          */
-        std::vector<char> getFile(const std::string& name);
+        std::vector<char> getFile(std::string_view name) const;
 
         /**
          * get a specific file from the archive
@@ -179,29 +1320,243 @@ namespace DatArchive {
          * @param buffer The buffer to store the file in
          * @return The size of the file
          */
-        uint64_t getFileRaw(const std::string& name, char* buffer);
+        uint64_t getFileRaw(std::string_view name, char* buffer) const;
+
+        /**
+         * Get several files from the archive at once
+         * <br>
+         * The files are read in the order they are stored in the archive rather than the order they are asked for, and
+         * files stored close together are read with a single read, which turns many small seeks into a few sequential
+         * reads.
+         * @param names The names of the files
+         * @return A byte vector for each name in the same order, empty if that file doesn't exist
+         */
+        std::vector<std::vector<char>> getFiles(std::span<const std::string_view> names) const;
+
+        /**
+         * Get several files from the archive at once into the given buffers
+         * <br>
+         * Warning, this function assumes that each buffer is large enough to wholly contain its file.
+         * <br>
+         * The files are read in the same way as getFiles()
+         * @param names The names of the files
+         * @param buffers The buffer to store each file in, in the same order as the names
+         * @return The size of each file in the same order, 0 if that file doesn't exist
+         */
+        std::vector<uint64_t> getFilesRaw(std::span<const std::string_view> names, std::span<char* const> buffers) const;
+
+        /**
+         * Get a view of a specific file directly inside the mapped archive, without copying it
+         * <br>
+         * This is only available for files stored without compression in an archive opened with ReadMode::MAPPED. The
+         * view remains valid until the archive is closed.
+         * @param name The name of the file
+         * @param validateCrc Whether to validate the CRC of the file
+         * @return A view of the file, empty if the file doesn't exist, is compressed, or the archive isn't mapped
+         */
+        std::span<const std::byte> getFileView(std::string_view name, bool validateCrc = true) const;
+
+        /**
+         * Get a specific file from the archive and write it to the given stream
+         * <br>
+         * The file is written a piece at a time, so it never has to be held in memory all at once
+         * @param name The name of the file
+         * @param stream The stream to write the file to
+         * @param validateCrc Whether to validate the CRC of the file
+         * @return true if successful, false if the file doesn't exist, couldn't be read, or failed its CRC check after
+         * being written
+         */
+        bool getFileToStream(std::string_view name, std::ostream& stream, bool validateCrc = true) const;
+
+        /**
+         * Open a specific file from the archive to be read a piece at a time
+         * @param name The name of the file
+         * @param validateCrc Whether to validate the CRC of the file once it has been read
+         * @return A stream of the file, already failed if the file doesn't exist
+         */
+        EntryStream openFile(std::string_view name, bool validateCrc = true) const;
+
+        /**
+         * Called with a file read by readFileAsync(), the file is empty if it doesn't exist or couldn't be read
+         */
+        using ReadCallback = std::function<void(std::vector<char>)>;
+
+        /**
+         * Read a specific file from the archive in the background
+         * <br>
+         * Where io_uring is available, the file's data is read through it, so any number of files can be read at once
+         * without a thread waiting on each one. Otherwise, and for files that take more than a single read, the file is
+         * read on a pool of threads. Files are checked and inflated on the pool, and any file io_uring fails to read is
+         * extracted there the usual way instead.
+         * <br>
+         * The callback is run on the pool, or on the calling thread before this returns if the file doesn't exist.
+         * The archive must not be closed while a read is in flight from one of the callbacks.
+         * @param name The name of the file
+         * @param callback Called with the file once it has been read
+         */
+        void readFileAsync(std::string_view name, ReadCallback callback) const;
+
+        /**
+         * Read a specific file from the archive in the background
+         * <br>
+         * This is the same as readFileAsync() with a callback, but the file is given through a future
+         * @param name The name of the file
+         * @return A future holding the file, which is empty if the file doesn't exist or couldn't be read
+         */
+        std::future<std::vector<char>> readFileAsync(std::string_view name) const;
+
+        /**
+         * Start reading the stored data of several files into memory in the background, ready for them to be read
+         * <br>
+         * The kernel is asked to read the files into the page cache without anything waiting for it, so a batch of files
+         * that will be needed soon, such as the assets for the next level, can be read while other work is being done.
+         * Files stored close together are asked for as a single range.
+         * @param names The names of the files, names of files that don't exist are ignored
+         * @return true if the archive is open
+         */
+        bool prefetch(std::span<const std::string_view> names) const;
+
+        /**
+         * Get a specific file from the archive as a buffer shared with the reader's cache
+         * <br>
+         * When the file is in the cache, the cached copy is returned as it is, without copying it. Otherwise it is
+         * extracted, and added to the cache if there is one. The buffer is never modified, and stays valid for as long
+         * as it is held, even after the file is dropped from the cache or the archive is closed.
+         * @param name The name of the file
+         * @return The file, nullptr if the file doesn't exist or couldn't be extracted
+         */
+        std::shared_ptr<const std::vector<char>> getFileShared(std::string_view name) const;
+
+        /**
+         * Get a specific file from the archive from a coroutine, without blocking the thread it is running on
+         * <br>
+         * The file is read as with readFileAsync(), and the awaiting coroutine is resumed once it has been read and
+         * checked.
+         * <br>
+         * Without an executor the coroutine runs on one of the reader's own threads, where closing or destroying the
+         * reader waits forever on the read that resumed it. An executor must be given if the coroutine, or anything it
+         * goes on to run on that thread, can close or destroy the reader.
+         * @param name The name of the file
+         * @param executor Where to resume the awaiting coroutine, nullptr to resume it on the reader's pool of threads,
+         * or straight away if the file doesn't exist
+         * @return An awaitable giving the file, which is empty if the file doesn't exist or couldn't be read
+         */
+        ReadAwaitable<std::vector<char>> getFileAsync(std::string_view name, Executor* executor = nullptr) const;
+
+        /**
+         * Get a specific file from the archive from a coroutine, without blocking the thread it is running on
+         * <br>
+         * The file is extracted as with getFileRaw() on the reader's pool of threads, and the awaiting coroutine is
+         * resumed once it is finished.
+         * <br>
+         * As with getFileAsync(), an executor must be given if the coroutine can close or destroy the reader.
+         * @param name The name of the file
+         * @param buffer The buffer to write the file to, which must stay valid until the coroutine is resumed
+         * @param executor Where to resume the awaiting coroutine, nullptr to resume it on the reader's pool of threads,
+         * or straight away if the file doesn't exist
+         * @return An awaitable giving the size of the file, which is 0 if the file couldn't be extracted
+         */
+        ReadAwaitable<uint64_t> getFileRawAsync(std::string_view name, char* buffer, Executor* executor = nullptr) const;
+
+        /**
+         * Extract every file in the archive into a directory
+         * <br>
+         * Names are split on '/' into directories, which are created as needed. Files whose names are absolute or
+         * contain "." or ".." components would end up outside the destination, so they are skipped.
+         * <br>
+         * Files are extracted on a pool of threads, in the order they are stored. Each output file is allocated at its
+         * full size before it is written, and files larger than EXTRACTBUFFERLIMIT are streamed to disk rather than
+         * being held in memory. Any file that fails its CRC check or can't be written is removed.
+         * @param destination The directory to extract into
+         * @param extractOptions Options controlling how the files are extracted
+         * @return true if every file was extracted or already existed, false if any were skipped or failed
+         */
+        bool extractAll(const std::filesystem::path& destination, ExtractOptions extractOptions = {}) const;
+
+        /**
+         * Read part of a specific file from the archive
+         * <br>
+         * Stored files are read with a single read of just the requested range, compressed files are only inflated as
+         * far as the end of the range. The CRC can't be validated without reading the whole file, so it isn't checked.
+         * @param name The name of the file
+         * @param offset The offset into the original file to start reading from
+         * @param length The number of bytes to read
+         * @param buffer The buffer to read into, must be at least length bytes long
+         * @return The number of bytes read, less than length if the range goes past the end of the file, 0 if the file
+         * couldn't be read
+         */
+        uint64_t readRange(std::string_view name, uint64_t offset, uint64_t length, char* buffer) const;
+
+        /**
+         * Build the inflate checkpoints of a specific compressed file, so later calls to readRange() can start from
+         * the nearest checkpoint instead of the start of the file
+         * <br>
+         * This inflates the whole file once. Checkpoints that already exist for the file are replaced.
+         * @param name The name of the file
+         * @param spacing The minimum distance in bytes between checkpoints
+         * @return true if successful, false if the file doesn't exist, isn't compressed with zlib or is damaged
+         */
+        bool buildCheckpoints(std::string_view name, uint64_t spacing) const;
+
+        /**
+         * Save every inflate checkpoint that has been built or loaded to a file, so they can be reused when the
+         * archive is opened again
+         * @param checkpointFilePath The path to write the checkpoints to
+         * @return true if successful
+         */
+        bool saveCheckpoints(const std::filesystem::path& checkpointFilePath) const;
 
-//        /**
-//         * Get a specific file from the archive and write it to the given stream
-//         * @param name The name of the file
-//         * @param stream The stream to write the file to
-//         * @return true if successful
-//         */
-//        bool getFileToStream(const std::string& name, std::ostream& stream);
+        /**
+         * Load inflate checkpoints previously saved with saveCheckpoints()
+         * <br>
+         * The checkpoints are only used if they were saved for an archive with the same size and table offset, and
+         * checkpoints for files that no longer match an entry are ignored.
+         * @param checkpointFilePath The path to read the checkpoints from
+         * @return true if successful, false if the file is missing, malformed or belongs to a different archive
+         */
+        bool loadCheckpoints(const std::filesystem::path& checkpointFilePath);
 
         /**
          * Get the file entry for the given filename
          * @param name The name of the file
          * @return The table entry that represents the file
+         * @throws std::out_of_range if the file isn't in the archive
          */
-        const TableEntry& getFileEntry(const std::string& name) const;
+        TableEntry getFileEntry(std::string_view name) const;
 
         /**
          * Get the whole file table
-         * @return The file table of the archive
+         * <br>
+         * Every entry is copied, with its own copy of its name. To look through the table without copying it, use
+         * entriesInTableOrder(), entriesByName() or entriesByOffset() instead.
+         * @return The file table of the archive, in the order it is stored in the archive
          */
         std::vector<DatArchive::TableEntry> getTable() const;
 
+        /**
+         * Get every entry in the table, in the order it is stored in the archive, without copying them
+         * @return The entries, valid until the archive is closed
+         */
+        EntryRange entriesInTableOrder() const;
+
+        /**
+         * Get every entry in the table in name order, without copying them
+         * <br>
+         * Version 2 tables are stored in this order already, version 1 tables are sorted the first time this or one
+         * of the listings is used.
+         * @return The entries, valid until the archive is closed
+         */
+        EntryRange entriesByName() const;
+
+        /**
+         * Get every entry in the table in the order their data is stored in the archive, without copying them
+         * <br>
+         * Reading files in this order reads the archive from start to end. The order is sorted the first time this is
+         * used.
+         * @return The entries, valid until the archive is closed
+         */
+        EntryRange entriesByOffset() const;
+
         /**
          * Get the offset from the beginning of the file to the Entry Table
          * @return The offset of the Entry Table
@@ -219,6 +1574,29 @@ namespace DatArchive {
          * @return True if the archive has errored
          */
         bool isBad() const;
+
+        /**
+         * Get how often the inflate states and buffers cached by each thread have been reused
+         * @return The counts for every reader since the last resetPoolStats()
+         */
+        static PoolStats getPoolStats();
+
+        /**
+         * Set the counts returned by getPoolStats() back to 0
+         */
+        static void resetPoolStats();
+
+        /**
+         * Get how well the cache of extracted files is doing
+         * @return The counts since the archive was opened or resetCacheStats() was last called, all 0 if there is no
+         * cache
+         */
+        CacheStats getCacheStats() const;
+
+        /**
+         * Set the hit, miss and eviction counts returned by getCacheStats() back to 0
+         */
+        void resetCacheStats() const;
     };
 
     /**
@@ -227,6 +1605,8 @@ namespace DatArchive {
     class DatArchiveWriter {
         std::map<std::filesystem::path, TableEntry> fileEntries;
 
+        WriterOptions options;
+
     private:
         /**
          * Write the header of the archive
@@ -244,13 +1624,35 @@ namespace DatArchive {
          */
         void writeFiles(std::fstream& archiveFile);
 
+        /**
+         * Write the queued files into the archive, compressing them on several threads
+         * <br>
+         * The archive is identical to the one writeFiles would write with a single thread
+         * @param archiveFile The archive file to write to
+         */
+        void parallelWriteFiles(std::fstream& archiveFile);
+
+        /**
+         * Read the given file and write it to a stream using the compression method of its entry
+         * <br>
+         * This sets the original size and CRC32 checksum of the entry, but not where its data is in the archive
+         * @param path The path to the file
+         * @param stream The stream to write the file to
+         * @param entry The file entry of the file
+         * @param pool The threads to deflate chunks on, nullptr to deflate them on this thread. This must not be called
+         * from one of its threads.
+         * @return true if successful, false if the file couldn't be opened
+         */
+        bool compressFile(const std::filesystem::path& path, std::ostream& stream, TableEntry& entry,
+                          ThreadPool* pool) const;
+
         /**
          * Write the given file to the archive
          * @param file The file to write into the archive
          * @param archiveFile The archive file to write to
          * @param entry The file entry of the file
          */
-        static void writeFileToArchive(std::fstream& file, std::fstream& archiveFile, TableEntry& entry);
+        static void writeFileToArchive(std::fstream& file, std::ostream& archiveFile, TableEntry& entry);
 
         /**
          * Compress the given file and write it to the archive
@@ -259,20 +1661,43 @@ namespace DatArchive {
          * @param entry The file entry of the file
          * @return The ZLib return code for the compression operation
          */
-        static int zlibCompressFileToArchive(std::fstream& file, std::fstream& archiveFile, TableEntry& entry);
+        static int zlibCompressFileToArchive(std::fstream& file, std::ostream& archiveFile, TableEntry& entry);
+
+        /**
+         * Compress the given file in ZLIBBLOCKSIZE blocks and write it to the archive, followed by its block table
+         * @param file The file to compress and write into the archive
+         * @param archiveFile The archive file to write to
+         * @param entry The file entry of the file
+         * @return The ZLib return code for the compression operation
+         */
+        static int zlibBlocksCompressFileToArchive(std::fstream& file, std::ostream& archiveFile, TableEntry& entry);
+
+        /**
+         * Compress the given file in DEFLATECHUNKSIZE chunks and write it to the archive as a single zlib stream
+         * <br>
+         * This assumes the original size of the entry has already been set
+         * @param file The file to compress and write into the archive
+         * @param archiveFile The archive file to write to
+         * @param entry The file entry of the file
+         * @param pool The threads to deflate the chunks on, nullptr to deflate them on this thread
+         * @return The ZLib return code for the compression operation
+         */
+        static int chunkedZlibCompressFileToArchive(std::fstream& file, std::ostream& archiveFile, TableEntry& entry,
+                                                    ThreadPool* pool);
 
         /**
-         * Write the location of the table to the header
+         * Pad the data so the table is aligned, then write the location of the table and the current version to the
+         * header
          * <br>
-         * This assumes the stream pointer is at the location at which the header will be written
-         * @param archiveFile
+         * This assumes the stream pointer is immediately after the data, it is left at the start of the table
+         * @param archiveFile The archive file to write to
          */
-        void writeTableLocation(std::fstream& archiveFile);
+        static void writeTableLocation(std::fstream& archiveFile);
 
         /**
          * Write the Entry Table to the archive
          * <br>
-         * This assumes the stream pointer is immediately after the data
+         * This assumes the stream pointer is at the start of the table
          * @param archiveFile The archive file to write to
          */
         void writeTable(std::fstream& archiveFile);
@@ -280,22 +1705,31 @@ namespace DatArchive {
         /**
          * Write the given Entry Table to the archive
          * <br>
-         * This assumes the stream pointer is immediately after the data
+         * This assumes the stream pointer is at the start of the table
          * @param archiveFile The archive file to write to
-         * @param entries The entries to write to the archive
+         * @param entries The entries to write to the archive, in any order
          */
-        void writeTable(std::fstream& archiveFile, const std::vector<TableEntry>& entries);
+        static void writeTable(std::fstream& archiveFile, std::vector<TableEntry> entries);
 
         /**
-         * Write the given Entry to the archive
+         * Write an Entry Table that is already made up of records to the archive
          * <br>
-         * This assumes the stream pointer is in the correct player already
+         * This assumes the stream pointer is at the start of the table
          * @param archiveFile The archive file to write to
-         * @param entry The entry to write
+         * @param records The entries to write to the archive, sorted by name
+         * @param nameHeap The names the records refer to
          */
-        void writeTableEntry(std::fstream& archiveFile, const TableEntry& entry);
+        static void writeTable(std::fstream& archiveFile, const std::vector<EntryRecord>& records,
+                               const std::string& nameHeap);
 
     public:
+        DatArchiveWriter() = default;
+
+        /**
+         * @param options Options controlling how archives are written
+         */
+        explicit DatArchiveWriter(WriterOptions options);
+
         /**
          * Queue a file to be inserted into the archive
          * @param path The path to the file that is being inserted
@@ -329,6 +1763,8 @@ namespace DatArchive {
          * <br>
          * This can add new files to the archive, but will not remove or overwrite existing files, any files queued to
          * be added that share a name with a file already in the archive will be discarded.
+         * <br>
+         * The table is always rewritten in the current version, so appending to a version 1 archive upgrades it.
          * @param destinationArchive The existing archive to append the new files onto
          * @return true if successful
          */
@@ -1,11 +1,368 @@
 #include "../include/dat-archive.h"
+#include "entry-cache.h"
+#include "fast-crc32.h"
+#include "inflate-pool.h"
+#include "parallel-inflate.h"
+#include "thread-pool.h"
+#include "uring-reader.h"
 
 #include <algorithm>
 #include <bitset>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <zlib.h>
 #include <cassert>
+#include <cerrno>
+#include <climits>
 #include <cstring>
+#include <deque>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    /** The signature used by index files */
+    constexpr char DATINDEXSIGNATURE[4] = {'\xB1', '\x49', '\x44', '\x58'};
+
+    /** The version of the index file written by this library */
+    constexpr uint8_t DATINDEXVERSION = 0x01;
+
+    /**
+     * The header of an index file
+     * <br>
+     * The header is followed by the entry records, the index slots and finally the name arena, so an index file can be
+     * mapped and used in place.
+     */
+    struct IndexFileHeader {
+        char signature[4];
+        uint8_t version;
+        uint8_t reserved[3];
+        /** The size of the archive the index was built for */
+        uint64_t archiveSize;
+        /** The table offset of the archive the index was built for */
+        uint64_t tableOffset;
+        /** The CRC32 checksum of the table the index was built for */
+        uint32_t tableCrc;
+        uint32_t reserved2;
+        uint64_t entryCount;
+        uint64_t slotCount;
+        uint64_t nameArenaSize;
+    };
+
+    /** The signature used by checkpoint files */
+    constexpr char DATCHECKPOINTSIGNATURE[4] = {'\xB1', '\x43', '\x48', '\x4B'};
+
+    /** The version of the checkpoint file written by this library */
+    constexpr uint8_t DATCHECKPOINTVERSION = 0x01;
+
+    /**
+     * The header of a checkpoint file
+     * <br>
+     * The header is followed by a CheckpointFileRecord for each file, each of which is followed by its checkpoints
+     */
+    struct CheckpointFileHeader {
+        char signature[4];
+        uint8_t version;
+        uint8_t reserved[3];
+        /** The size of the archive the checkpoints were built for */
+        uint64_t archiveSize;
+        /** The table offset of the archive the checkpoints were built for */
+        uint64_t tableOffset;
+        uint64_t fileCount;
+    };
+
+    /**
+     * The file a set of checkpoints belongs to
+     */
+    struct CheckpointFileRecord {
+        uint64_t dataStart;
+        uint64_t dataEnd;
+        uint64_t originalSize;
+        uint32_t crc32;
+        uint32_t reserved;
+        uint64_t checkpointCount;
+    };
+
+    /**
+     * A single checkpoint, followed by its INFLATEWINDOWSIZE byte window
+     */
+    struct CheckpointRecord {
+        uint64_t compressedOffset;
+        uint64_t originalOffset;
+        uint8_t bits;
+        uint8_t reserved[7];
+    };
+
+    /**
+     * The footer at the very end of a file compressed with CompressionMethod::ZLIB_BLOCKS, it is preceded by the offset
+     * of the end of each block
+     */
+    struct BlockTableFooter {
+        uint32_t blockSize;
+        uint32_t blockCount;
+    };
+
+    /**
+     * Map part of a file into memory
+     * @param path The path to the file
+     * @param offset The offset to start the mapping from, rounded down to the start of its page
+     * @param size Set to the size of the mapping, from the rounded down offset to the end of the file
+     * @return The mapping, nullptr if the file couldn't be mapped
+     */
+    const std::byte* mapFile(const std::filesystem::path& path, uint64_t offset, uint64_t& size) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0 || (uint64_t) fileStat.st_size <= offset) {
+            close(fd);
+            return nullptr;
+        }
+
+        // Mappings have to start on a page boundary
+        uint64_t pageSize = sysconf(_SC_PAGESIZE);
+        uint64_t mapStart = offset - offset % pageSize;
+        uint64_t mapSize = fileStat.st_size - mapStart;
+
+        void* mapping = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, (off_t) mapStart);
+
+        // The mapping keeps its own reference to the file
+        close(fd);
+
+        if (mapping == MAP_FAILED) return nullptr;
+
+        size = mapSize;
+        return static_cast<const std::byte*>(mapping);
+    }
+
+    /**
+     * Write all of a buffer to a file descriptor
+     * @param fd The file descriptor
+     * @param buffer The data to write
+     * @param size The size of the data in bytes
+     * @return true if all the data was written
+     */
+    bool writeAll(int fd, const char* buffer, uint64_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, buffer, size);
+
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            buffer += written;
+            size -= written;
+        }
+
+        return true;
+    }
+
+    /**
+     * Turn the name of a file in an archive into a path relative to where it is being extracted
+     * @param name The name of the file
+     * @param path Set to the relative path
+     * @return true if successful, false if the name would put the file outside of where it is being extracted
+     */
+    bool relativeExtractPath(std::string_view name, std::filesystem::path& path) {
+        if (name.empty() || name.front() == '/' || name.find('\0') != std::string_view::npos) return false;
+
+        path.clear();
+        while (!name.empty()) {
+            size_t split = name.find('/');
+            std::string_view component = name.substr(0, split);
+            name = split == std::string_view::npos ? std::string_view() : name.substr(split + 1);
+
+            if (component.empty()) continue;
+            if (component == "." || component == "..") return false;
+
+            path /= component;
+        }
+
+        return !path.empty();
+    }
+
+    /**
+     * Add a record for an entry to a table being written
+     * @param records The records of the table, the new record is added to the end
+     * @param nameHeap The names of the table, the entry's name is added to the end
+     * @param entry The entry
+     */
+    void appendRecord(std::vector<DatArchive::EntryRecord>& records, std::string& nameHeap,
+                      const DatArchive::TableEntry& entry) {
+        DatArchive::EntryRecord& record = records.emplace_back();
+        record.originalSize = entry.originalSize;
+        record.dataStart = entry.dataStart;
+        record.dataEnd = entry.dataEnd;
+        record.nameOffset = nameHeap.size();
+        record.crc32 = entry.crc32;
+        record.nameLength = entry.name.size();
+        record.compressionMethod = entry.compressionMethod;
+        record.fileFlags = (uint8_t) entry.fileFlags;
+
+        nameHeap.append(entry.name, 0, record.nameLength);
+    }
+
+    /**
+     * Find the first position in a range that doesn't satisfy a predicate, where every position satisfying it comes
+     * before every position that doesn't
+     * @param first The start of the range
+     * @param last One past the end of the range
+     * @param predicate Checks a position
+     * @return The first position that doesn't satisfy the predicate, last if they all do
+     */
+    template<typename Predicate>
+    size_t partitionPoint(size_t first, size_t last, Predicate predicate) {
+        while (first < last) {
+            size_t middle = first + (last - first) / 2;
+
+            if (predicate(middle)) first = middle + 1;
+            else last = middle;
+        }
+
+        return first;
+    }
+
+    /**
+     * Match a character against a bracket expression in a glob pattern, such as "[a-z]"
+     * @param pattern The pattern, starting just after the '['
+     * @param character The character to match
+     * @param matched Set to whether the character matched
+     * @return The length of the expression after the '[', including the closing ']', 0 if it is never closed
+     */
+    size_t matchBracket(std::string_view pattern, char character, bool& matched) {
+        size_t position = 0;
+
+        bool negated = !pattern.empty() && (pattern.front() == '!' || pattern.front() == '^');
+        if (negated) ++position;
+
+        // A ']' straight after the opening is part of the set rather than the end of it
+        size_t setStart = position;
+        bool found = false;
+        while (position < pattern.size() && (pattern[position] != ']' || position == setStart)) {
+            auto low = (unsigned char) pattern[position];
+            auto high = low;
+
+            if (position + 2 < pattern.size() && pattern[position + 1] == '-' && pattern[position + 2] != ']') {
+                high = (unsigned char) pattern[position + 2];
+                position += 3;
+            } else {
+                ++position;
+            }
+
+            if ((unsigned char) character >= low && (unsigned char) character <= high) found = true;
+        }
+
+        if (position >= pattern.size()) return 0;
+
+        matched = found != negated && character != '/';
+        return position + 1;
+    }
+
+    /**
+     * Check whether a name matches a glob pattern, see DatArchiveReader::matchFiles() for the syntax
+     * @param pattern The pattern
+     * @param name The name
+     * @return true if the whole name matches the whole pattern
+     */
+    bool globMatch(std::string_view pattern, std::string_view name) {
+        while (!pattern.empty()) {
+            if (pattern.front() == '*') {
+                bool crossDirectories = pattern.size() > 1 && pattern[1] == '*';
+                pattern.remove_prefix(crossDirectories ? 2 : 1);
+
+                // "**/" can stand for no directories at all
+                if (crossDirectories && !pattern.empty() && pattern.front() == '/'
+                    && globMatch(pattern.substr(1), name)) {
+                    return true;
+                }
+
+                // When only ordinary characters follow, they can only match the end of the name
+                if (pattern.find_first_of("*?[\\") == std::string_view::npos) {
+                    if (!name.ends_with(pattern)) return false;
+
+                    std::string_view skipped = name.substr(0, name.size() - pattern.size());
+                    return crossDirectories || skipped.find('/') == std::string_view::npos;
+                }
+
+                for (size_t skip = 0;; ++skip) {
+                    if (globMatch(pattern, name.substr(skip))) return true;
+                    if (skip == name.size() || (!crossDirectories && name[skip] == '/')) return false;
+                }
+            }
+
+            if (pattern.front() == '?') {
+                if (name.empty() || name.front() == '/') return false;
+
+                pattern.remove_prefix(1);
+                name.remove_prefix(1);
+                continue;
+            }
+
+            if (pattern.front() == '[' && !name.empty()) {
+                bool matched = false;
+                size_t length = matchBracket(pattern.substr(1), name.front(), matched);
+
+                // A '[' that is never closed is an ordinary character
+                if (length != 0) {
+                    if (!matched) return false;
+
+                    pattern.remove_prefix(length + 1);
+                    name.remove_prefix(1);
+                    continue;
+                }
+            }
+
+            // A backslash escapes the character after it
+            if (pattern.front() == '\\' && pattern.size() > 1) pattern.remove_prefix(1);
+
+            if (name.empty() || name.front() != pattern.front()) return false;
+
+            pattern.remove_prefix(1);
+            name.remove_prefix(1);
+        }
+
+        return name.empty();
+    }
+
+    /**
+     * Get the part of a glob pattern before its first wildcard, which every matching name must start with
+     * @param pattern The pattern
+     * @return The literal start of the pattern, with escapes removed
+     */
+    std::string literalPrefix(std::string_view pattern) {
+        std::string prefix;
+
+        for (size_t position = 0; position < pattern.size(); ++position) {
+            char character = pattern[position];
+            if (character == '*' || character == '?' || character == '[') break;
+
+            if (character == '\\' && position + 1 < pattern.size()) character = pattern[++position];
+            prefix += character;
+        }
+
+        return prefix;
+    }
+
+    /**
+     * Release a mapping made by mapFile, if there is one
+     * @param mapping The mapping, set to nullptr once released
+     * @param size The size of the mapping, set to 0 once released
+     */
+    void unmapFile(const std::byte*& mapping, uint64_t& size) {
+        if (mapping == nullptr) return;
+
+        munmap(const_cast<std::byte*>(mapping), size);
+        mapping = nullptr;
+        size = 0;
+    }
+}
 
 /*
  * Flags
@@ -29,247 +386,2229 @@ uint64_t DatArchive::TableEntry::sizeInArchive() const {
     return dataEnd - dataStart;
 }
 
+/*
+ * EntryRecord
+ */
+
+uint64_t DatArchive::EntryRecord::sizeInArchive() const {
+    return dataEnd - dataStart;
+}
+
+std::string_view DatArchive::EntryRecord::name(std::string_view nameArena) const {
+    // Mapped tables are only checked as they're used, so a bad offset must not be allowed to escape the arena
+    if (nameOffset > nameArena.size()) return {};
+    return nameArena.substr(nameOffset, nameLength);
+}
+
+DatArchive::TableEntry DatArchive::EntryRecord::toTableEntry(std::string_view nameArena) const {
+    TableEntry entry(std::string(name(nameArena)), compressionMethod, Flags(fileFlags));
+    entry.crc32 = crc32;
+    entry.originalSize = originalSize;
+    entry.dataStart = dataStart;
+    entry.dataEnd = dataEnd;
+
+    return entry;
+}
+
+/*
+ * EntryView
+ */
+
+DatArchive::EntryView::EntryView(const DatArchive::EntryRecord& entry, std::string_view nameArena)
+        : entry(&entry), nameArena(nameArena) {}
+
+std::string_view DatArchive::EntryView::name() const {
+    return entry->name(nameArena);
+}
+
+const DatArchive::EntryRecord& DatArchive::EntryView::record() const {
+    return *entry;
+}
+
+DatArchive::TableEntry DatArchive::EntryView::toTableEntry() const {
+    return entry->toTableEntry(nameArena);
+}
+
+/*
+ * EntryRange
+ */
+
+DatArchive::EntryRange::EntryRange(std::span<const EntryRecord> entries, std::string_view nameArena,
+                                   const size_t* order) : entries(entries), nameArena(nameArena), order(order) {}
+
+DatArchive::EntryRange::Iterator DatArchive::EntryRange::begin() const {
+    return {*this, 0};
+}
+
+DatArchive::EntryRange::Iterator DatArchive::EntryRange::end() const {
+    return {*this, entries.size()};
+}
+
+size_t DatArchive::EntryRange::size() const {
+    return entries.size();
+}
+
+bool DatArchive::EntryRange::empty() const {
+    return entries.empty();
+}
+
+DatArchive::EntryView DatArchive::EntryRange::operator[](size_t position) const {
+    return {entries[order != nullptr ? order[position] : position], nameArena};
+}
+
+/*
+ * EntryIndex
+ */
+
+uint64_t DatArchive::EntryIndex::hashName(std::string_view name) {
+    // 64-bit FNV-1a, this needs to be stable so it can't rely on std::hash
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c: name) {
+        hash ^= (unsigned char) c;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+bool DatArchive::EntryIndex::adopt(std::span<const Slot> builtSlots, size_t entryCount) {
+    // The capacity must be a power of two for the mask to work
+    if (builtSlots.size() < 8 || (builtSlots.size() & (builtSlots.size() - 1)) != 0) return false;
+
+    // Every probe needs an empty slot to stop at, and every entry must be inside the table
+    bool hasEmptySlot = false;
+    for (const Slot& slot: builtSlots) {
+        if (slot.entry > entryCount) return false;
+        if (slot.entry == 0) hasEmptySlot = true;
+    }
+    if (!hasEmptySlot) return false;
+
+    slotStorage.clear();
+    slots = builtSlots;
+    this->entryCount = entryCount;
+
+    return true;
+}
+
+std::span<const DatArchive::EntryIndex::Slot> DatArchive::EntryIndex::getSlots() const {
+    return slots;
+}
+
+void DatArchive::EntryIndex::clear() {
+    slotStorage.clear();
+    slots = {};
+    entryCount = 0;
+}
+
 /*
  * Reader
  */
 
 bool DatArchive::DatArchiveReader::validateArchive(char* signature, uint8_t version) {
-    return strncmp(DATFILESIGNATURE, signature, 4) == 0 && DATFILEVERSION == version;
+    return strncmp(DATFILESIGNATURE, signature, 4) == 0
+           && DATFILEMINIMUMVERSION <= version && version <= DATFILEVERSION;
 }
 
 bool DatArchive::DatArchiveReader::loadTable() {
-    archive.seekg(tableOffset);
-
-    if (archive.fail() || tableOffset == 0) {
+    if (tableOffset == 0 || tableOffset > archiveSize) {
         return false;
     }
 
-    uint16_t nameLength;
-    while (archive.read(reinterpret_cast<char*>(&nameLength), 2)) {
-        TableEntry entry;
+    uint64_t tableSize = archiveSize - tableOffset;
+
+    if (archiveVersion >= 2) {
+        if (mappedArchive != nullptr) {
+            return loadSortedTable(reinterpret_cast<const char*>(mappedArchive) + tableOffset, tableSize);
+        }
+
+        if (!mapTable()) return false;
+        return loadSortedTable(reinterpret_cast<const char*>(mappedTable + mappedTableSize - tableSize), tableSize);
+    }
+
+    if (!options.useIndexFile) {
+        // A mapped table can be decoded where it is, otherwise read the whole thing into memory in one go
+        if (mappedArchive != nullptr) {
+            return parseTable(reinterpret_cast<const char*>(mappedArchive) + tableOffset, tableSize);
+        }
+
+        std::unique_ptr<char[]> table(new char[tableSize]);
+        if (!readFromArchive(tableOffset, table.get(), tableSize)) return false;
+
+        return parseTable(table.get(), tableSize);
+    }
+
+    // The table only needs to be checksummed when there is an index file, so map it rather than copying it
+    const char* table;
+    if (mappedArchive != nullptr) {
+        table = reinterpret_cast<const char*>(mappedArchive) + tableOffset;
+    } else {
+        if (!mapTable()) return false;
+        table = reinterpret_cast<const char*>(mappedTable + mappedTableSize - tableSize);
+    }
+
+    uint32_t tableCrc = fastCrc32(0, reinterpret_cast<const unsigned char*>(table), tableSize);
+
+    bool success = loadIndexFile(tableCrc);
+    if (!success && parseTable(table, tableSize)) {
+        success = true;
+
+        // Failing to save the index only costs the next reader the time it takes to parse the table
+        writeIndexFile(tableCrc);
+    }
+
+    // The entries are either copied out of the table or held in the index file, so the table isn't needed anymore
+    unmapFile(mappedTable, mappedTableSize);
+
+    return success;
+}
 
+bool DatArchive::DatArchiveReader::parseTable(const char* table, uint64_t tableSize) {
+    // The size of an entry in the table, excluding its name
+    constexpr uint64_t fixedEntrySize = 2 + 1 + 1 + 4 + 8 + 8 + 8;
+
+    // Walk the table once to check every entry fits and to find out how much needs to be allocated
+    uint64_t entryCount = 0;
+    uint64_t nameBytes = 0;
+    for (uint64_t position = 0; position < tableSize; ++entryCount) {
+        if (tableSize - position < fixedEntrySize) return false;
+
+        uint16_t nameLength;
+        memcpy(&nameLength, table + position, 2);
+
+        if (tableSize - position < fixedEntrySize + nameLength) return false;
+
+        position += fixedEntrySize + nameLength;
+        nameBytes += nameLength;
+    }
+
+    // The index refers to entries with 32 bit positions
+    if (entryCount >= UINT32_MAX) return false;
+
+    entryStorage.resize(entryCount);
+    nameStorage.resize(nameBytes);
+
+    const char* cursor = table;
+    uint64_t nameOffset = 0;
+    for (EntryRecord& entry: entryStorage) {
         // Name
-        entry.name.resize(nameLength);
-        archive.read(entry.name.data(), nameLength);
+        memcpy(&entry.nameLength, cursor, 2);
+        cursor += 2;
+        entry.nameOffset = nameOffset;
+        memcpy(nameStorage.data() + nameOffset, cursor, entry.nameLength);
+        cursor += entry.nameLength;
+        nameOffset += entry.nameLength;
 
         // Compression Method
-        archive.read(reinterpret_cast<char*>(&entry.compressionMethod), 1);
+        memcpy(&entry.compressionMethod, cursor, 1);
+        cursor += 1;
 
         // Flags
-        archive.read(reinterpret_cast<char*>(&entry.fileFlags), 1);
+        memcpy(&entry.fileFlags, cursor, 1);
+        cursor += 1;
 
         // crc32
-        archive.read(reinterpret_cast<char*>(&entry.crc32), 4);
+        memcpy(&entry.crc32, cursor, 4);
+        cursor += 4;
 
         // Original Size
-        archive.read(reinterpret_cast<char*>(&entry.originalSize), 8);
+        memcpy(&entry.originalSize, cursor, 8);
+        cursor += 8;
 
         // Data Start
-        archive.read(reinterpret_cast<char*>(&entry.dataStart), 8);
+        memcpy(&entry.dataStart, cursor, 8);
+        cursor += 8;
 
         // Data End
-        archive.read(reinterpret_cast<char*>(&entry.dataEnd), 8);
+        memcpy(&entry.dataEnd, cursor, 8);
+        cursor += 8;
 
-        entries.emplace(entry.name, entry);
+        // All the data must sit between the header and the table
+        if (entry.dataStart > entry.dataEnd || entry.dataEnd > tableOffset) {
+            entryStorage.clear();
+            nameStorage.clear();
+            return false;
+        }
     }
 
-    archive.clear();
-    archive.seekg(0);
+    entries = entryStorage;
+    nameArena = nameStorage;
+    sortedTable = false;
+
+    entryIndex.build(entries.size(), [this](size_t position) {
+        return entries[position].name(nameArena);
+    });
+
+    return true;
+}
+
+bool DatArchive::DatArchiveReader::loadSortedTable(const char* table, uint64_t tableSize) {
+    // The table starts with the number of entries and the size of the name heap
+    constexpr uint64_t tableHeaderSize = 8 + 8;
+
+    if (tableSize < tableHeaderSize) return false;
+
+    uint64_t entryCount;
+    uint64_t nameHeapSize;
+    memcpy(&entryCount, table, 8);
+    memcpy(&nameHeapSize, table + 8, 8);
+
+    uint64_t recordSpace = tableSize - tableHeaderSize;
+    if (entryCount > recordSpace / sizeof(EntryRecord)) return false;
+    if (nameHeapSize > recordSpace - entryCount * sizeof(EntryRecord)) return false;
+
+    const char* records = table + tableHeaderSize;
+
+    // The writer aligns the table so the records can be used where they are, anything else has to be copied out
+    if (reinterpret_cast<uintptr_t>(records) % alignof(EntryRecord) == 0) {
+        entries = std::span(reinterpret_cast<const EntryRecord*>(records), entryCount);
+    } else {
+        entryStorage.resize(entryCount);
+        memcpy(entryStorage.data(), records, entryCount * sizeof(EntryRecord));
+        entries = entryStorage;
+    }
+
+    nameArena = std::string_view(records + entryCount * sizeof(EntryRecord), nameHeapSize);
+    sortedTable = true;
+
+    return true;
+}
+
+bool DatArchive::DatArchiveReader::mapArchive() {
+    mappedArchive = mapFile(archivePath, 0, mappedSize);
+
+    return mappedArchive != nullptr;
+}
+
+bool DatArchive::DatArchiveReader::mapTable() {
+    mappedTable = mapFile(archivePath, tableOffset, mappedTableSize);
+
+    return mappedTable != nullptr;
+}
+
+std::filesystem::path DatArchive::DatArchiveReader::indexFilePath() const {
+    std::filesystem::path indexPath = archivePath;
+    indexPath += ".idx";
+
+    return indexPath;
+}
+
+bool DatArchive::DatArchiveReader::loadIndexFile(uint32_t tableCrc) {
+    uint64_t indexSize = 0;
+    const std::byte* index = mapFile(indexFilePath(), 0, indexSize);
+    if (index == nullptr) return false;
+
+    IndexFileHeader header{};
+    bool valid = indexSize >= sizeof(header);
+
+    if (valid) {
+        memcpy(&header, index, sizeof(header));
+
+        // The index is only usable if it was built for this exact table
+        valid = strncmp(DATINDEXSIGNATURE, header.signature, 4) == 0
+                && header.version == DATINDEXVERSION
+                && header.archiveSize == archiveSize
+                && header.tableOffset == tableOffset
+                && header.tableCrc == tableCrc;
+    }
+
+    if (valid) {
+        uint64_t space = indexSize - sizeof(header);
+
+        valid = header.entryCount <= space / sizeof(EntryRecord)
+                && header.slotCount <= (space - header.entryCount * sizeof(EntryRecord)) / sizeof(EntryIndex::Slot)
+                && header.nameArenaSize == space - header.entryCount * sizeof(EntryRecord)
+                                                 - header.slotCount * sizeof(EntryIndex::Slot);
+    }
+
+    const std::byte* records = index + sizeof(header);
+    const std::byte* slots = records + header.entryCount * sizeof(EntryRecord);
+    const std::byte* names = slots + header.slotCount * sizeof(EntryIndex::Slot);
+
+    if (!valid || !entryIndex.adopt(std::span(reinterpret_cast<const EntryIndex::Slot*>(slots), header.slotCount),
+                                    header.entryCount)) {
+        unmapFile(index, indexSize);
+        return false;
+    }
+
+    entries = std::span(reinterpret_cast<const EntryRecord*>(records), header.entryCount);
+    nameArena = std::string_view(reinterpret_cast<const char*>(names), header.nameArenaSize);
+    sortedTable = false;
+
+    mappedIndex = index;
+    mappedIndexSize = indexSize;
+
+    return true;
+}
+
+bool DatArchive::DatArchiveReader::writeIndexFile(uint32_t tableCrc) const {
+    std::span<const EntryIndex::Slot> slots = entryIndex.getSlots();
+
+    IndexFileHeader header{};
+    memcpy(header.signature, DATINDEXSIGNATURE, 4);
+    header.version = DATINDEXVERSION;
+    header.archiveSize = archiveSize;
+    header.tableOffset = tableOffset;
+    header.tableCrc = tableCrc;
+    header.entryCount = entries.size();
+    header.slotCount = slots.size();
+    header.nameArenaSize = nameArena.size();
+
+    // Write to a temporary file first so other readers never see a partially written index
+    std::filesystem::path indexPath = indexFilePath();
+    std::filesystem::path temporaryPath = indexPath;
+    temporaryPath += ".tmp";
+
+    std::ofstream indexFile(temporaryPath, std::ios::binary | std::ios::trunc);
+    indexFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    indexFile.write(reinterpret_cast<const char*>(entries.data()), (std::streamsize) entries.size_bytes());
+    indexFile.write(reinterpret_cast<const char*>(slots.data()), (std::streamsize) slots.size_bytes());
+    indexFile.write(nameArena.data(), (std::streamsize) nameArena.size());
+    indexFile.close();
+
+    std::error_code error;
+    if (indexFile.fail()) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    std::filesystem::rename(temporaryPath, indexPath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
 
     return true;
 }
 
+void DatArchive::DatArchiveReader::unmapArchive() {
+    unmapFile(mappedArchive, mappedSize);
+    unmapFile(mappedTable, mappedTableSize);
+    unmapFile(mappedIndex, mappedIndexSize);
+}
+
+const DatArchive::EntryRecord* DatArchive::DatArchiveReader::findEntry(std::string_view name) const {
+    if (sortedTable) {
+        auto entry = std::lower_bound(entries.begin(), entries.end(), name,
+                                      [this](const EntryRecord& entry, std::string_view name) {
+                                          return entry.name(nameArena) < name;
+                                      });
+
+        return entry != entries.end() && entry->name(nameArena) == name ? &*entry : nullptr;
+    }
+
+    size_t position = entryIndex.find(name, [this](size_t position) {
+        return entries[position].name(nameArena);
+    });
+
+    return position != EntryIndex::NOT_FOUND ? &entries[position] : nullptr;
+}
+
+void DatArchive::DatArchiveReader::buildNameOrder() const {
+    if (sortedTable || nameOrderBuilt.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> lock(orderMutex);
+    if (nameOrderBuilt.load(std::memory_order_relaxed)) return;
+
+    nameOrder.resize(entries.size());
+    std::iota(nameOrder.begin(), nameOrder.end(), 0);
+    std::sort(nameOrder.begin(), nameOrder.end(), [this](size_t a, size_t b) {
+        return entries[a].name(nameArena) < entries[b].name(nameArena);
+    });
+
+    nameOrderBuilt.store(true, std::memory_order_release);
+}
+
+void DatArchive::DatArchiveReader::buildDataOrder() const {
+    if (dataOrderBuilt.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> lock(orderMutex);
+    if (dataOrderBuilt.load(std::memory_order_relaxed)) return;
+
+    dataOrder.resize(entries.size());
+    std::iota(dataOrder.begin(), dataOrder.end(), 0);
+    std::stable_sort(dataOrder.begin(), dataOrder.end(), [this](size_t a, size_t b) {
+        return entries[a].dataStart < entries[b].dataStart;
+    });
+
+    dataOrderBuilt.store(true, std::memory_order_release);
+}
+
+std::string_view DatArchive::DatArchiveReader::nameInOrder(size_t position) const {
+    return entries[sortedTable ? position : nameOrder[position]].name(nameArena);
+}
+
+std::pair<size_t, size_t> DatArchive::DatArchiveReader::prefixRange(std::string_view prefix) const {
+    // Names starting with the prefix sit together in name order, after every name that sorts before the prefix
+    size_t first = partitionPoint(0, entries.size(), [this, prefix](size_t position) {
+        return nameInOrder(position) < prefix;
+    });
+    size_t last = partitionPoint(first, entries.size(), [this, prefix](size_t position) {
+        return nameInOrder(position).starts_with(prefix);
+    });
+
+    return {first, last};
+}
+
+bool DatArchive::DatArchiveReader::readFromArchive(uint64_t offset, char* buffer, uint64_t size) const {
+    if (mappedArchive != nullptr) {
+        if (offset > mappedSize || size > mappedSize - offset) return false;
+
+        memcpy(buffer, mappedArchive + offset, size);
+        return true;
+    }
+
+    if (archiveDescriptor >= 0) {
+        while (size > 0) {
+            ssize_t bytesRead = pread(archiveDescriptor, buffer, size, (off_t) offset);
+
+            if (bytesRead < 0) {
+                if (errno == EINTR) continue;
+
+                badFlag = true;
+                return false;
+            }
+            // Hit the end of the file
+            if (bytesRead == 0) return false;
+
+            buffer += bytesRead;
+            offset += bytesRead;
+            size -= bytesRead;
+        }
+
+        return true;
+    }
+
+    std::lock_guard lock(archiveMutex);
+
+    archive.seekg((std::streamoff) offset);
+    archive.read(buffer, (std::streamsize) size);
+
+    if (archive.bad()) badFlag = true;
+
+    bool success = !archive.fail();
+    archive.clear();
+
+    return success;
+}
+
+uint64_t
+DatArchive::DatArchiveReader::getFileFromEntry(const DatArchive::EntryRecord& entry, char* buffer, bool validateCrc) const {
+    uint64_t cached = getFileFromCache(entry, buffer);
+    if (cached != 0) return cached;
+
+    uint64_t size = extractFromEntry(entry, buffer, validateCrc);
+    if (options.dropAfterRead && entry.dataEnd > entry.dataStart) {
+        adviseRange(entry.dataStart, entry.sizeInArchive(), Advice::DONTNEED);
+    }
+
+    // Only files that have been checked are kept, as the cache hands them out whether checking is asked for or not
+    if (validateCrc && size == entry.originalSize) addFileToCache(entry, buffer, size);
+
+    return size;
+}
+
 uint64_t
-DatArchive::DatArchiveReader::getFileFromEntry(const DatArchive::TableEntry& entry, char* buffer, bool validateCrc) {
+DatArchive::DatArchiveReader::extractFromEntry(const DatArchive::EntryRecord& entry, char* buffer, bool validateCrc) const {
+    // All the data must sit between the header and the table
+    if (entry.dataStart > entry.dataEnd || entry.dataEnd > tableOffset) return 0;
+
     switch (entry.compressionMethod) {
         case CompressionMethod::NONE:
             return extractFile(entry, buffer, validateCrc);
             break;
         case CompressionMethod::ZLIB:
-            return zlibExtractFile(entry, buffer, validateCrc);
+            return zlibExtractFile(entry, buffer, validateCrc);
+            break;
+        case CompressionMethod::ZLIB_BLOCKS:
+            return zlibBlocksExtractFile(entry, buffer, validateCrc);
+            break;
+    }
+
+    return 0;
+}
+
+void DatArchive::DatArchiveReader::adviseRange(uint64_t offset, uint64_t size, Advice advice) const {
+    // Pages of a mapping are only read ahead, or let go of, when the mapping is told as well
+    if (mappedArchive != nullptr && offset < mappedSize) {
+        int mappingAdvice = MADV_NORMAL;
+        switch (advice) {
+            case Advice::NORMAL:
+                mappingAdvice = MADV_NORMAL;
+                break;
+            case Advice::SEQUENTIAL:
+                mappingAdvice = MADV_SEQUENTIAL;
+                break;
+            case Advice::RANDOM:
+                mappingAdvice = MADV_RANDOM;
+                break;
+            case Advice::WILLNEED:
+                mappingAdvice = MADV_WILLNEED;
+                break;
+            case Advice::DONTNEED:
+                mappingAdvice = MADV_DONTNEED;
+                break;
+        }
+
+        // The start has to be on a page boundary
+        auto pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+        uint64_t start = offset / pageSize * pageSize;
+        uint64_t end = size == 0 || size > mappedSize - offset ? mappedSize : offset + size;
+
+        madvise(const_cast<std::byte*>(mappedArchive) + start, end - start, mappingAdvice);
+    }
+
+#ifdef POSIX_FADV_NORMAL
+    int descriptor = archiveDescriptor >= 0 ? archiveDescriptor : hintDescriptor;
+    if (descriptor < 0) return;
+
+    int fileAdvice = POSIX_FADV_NORMAL;
+    switch (advice) {
+        case Advice::NORMAL:
+            fileAdvice = POSIX_FADV_NORMAL;
+            break;
+        case Advice::SEQUENTIAL:
+            fileAdvice = POSIX_FADV_SEQUENTIAL;
+            break;
+        case Advice::RANDOM:
+            fileAdvice = POSIX_FADV_RANDOM;
+            break;
+        case Advice::WILLNEED:
+            fileAdvice = POSIX_FADV_WILLNEED;
+            break;
+        case Advice::DONTNEED:
+            fileAdvice = POSIX_FADV_DONTNEED;
+            break;
+    }
+
+    posix_fadvise(descriptor, (off_t) offset, (off_t) size, fileAdvice);
+#endif
+}
+
+void DatArchive::DatArchiveReader::adviseWillNeed(std::span<const EntryRecord* const> sorted) const {
+    for (size_t first = 0; first < sorted.size();) {
+        uint64_t rangeStart = sorted[first]->dataStart;
+        uint64_t rangeEnd = std::max(rangeStart, sorted[first]->dataEnd);
+
+        size_t last = first + 1;
+        for (; last < sorted.size() && sorted[last]->dataStart <= rangeEnd + COALESCEGAP; ++last) {
+            rangeEnd = std::max(rangeEnd, sorted[last]->dataEnd);
+        }
+
+        if (rangeEnd > rangeStart && rangeEnd <= tableOffset) {
+            adviseRange(rangeStart, rangeEnd - rangeStart, Advice::WILLNEED);
+        }
+
+        first = last;
+    }
+}
+
+uint64_t DatArchive::DatArchiveReader::getFileFromCache(const DatArchive::EntryRecord& entry, char* buffer) const {
+    if (cache == nullptr || !cache->fits(entry.originalSize)) return 0;
+
+    std::shared_ptr<const std::vector<char>> cached = cache->find(entry);
+    if (cached == nullptr || cached->size() != entry.originalSize) return 0;
+
+    memcpy(buffer, cached->data(), cached->size());
+    return cached->size();
+}
+
+void DatArchive::DatArchiveReader::addFileToCache(const DatArchive::EntryRecord& entry, const char* file,
+                                                  uint64_t size) const {
+    if (cache == nullptr || !cache->fits(size)) return;
+
+    cache->insert(entry, std::make_shared<const std::vector<char>>(file, file + size));
+}
+
+std::vector<uint64_t> DatArchive::DatArchiveReader::getFilesFromEntries(std::span<const EntryRecord* const> entries,
+                                                                       std::span<char* const> buffers) const {
+    std::vector<uint64_t> sizes(entries.size(), 0);
+
+    // Visit the files in the order they are stored, so the archive is read from start to end
+    std::vector<size_t> order;
+    order.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i] == nullptr) continue;
+
+        // Cached files don't need reading at all
+        sizes[i] = getFileFromCache(*entries[i], buffers[i]);
+        if (sizes[i] == 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+        return entries[a]->dataStart < entries[b]->dataStart;
+    });
+
+    // Let the kernel read the later files while the earlier ones are being inflated
+    if (order.size() > 1) {
+        std::vector<const EntryRecord*> sorted;
+        sorted.reserve(order.size());
+        for (size_t i: order) sorted.push_back(entries[i]);
+
+        adviseWillNeed(sorted);
+    }
+
+    // There is nothing to gain from grouping reads of a mapped archive
+    if (mappedArchive != nullptr) {
+        for (size_t i: order) sizes[i] = getFileFromEntry(*entries[i], buffers[i]);
+        return sizes;
+    }
+
+    // Files in blocks need their block table, and large files are better off streamed, so both are read on their own
+    auto readAlone = [](const EntryRecord& entry) {
+        return entry.compressionMethod == CompressionMethod::ZLIB_BLOCKS || entry.dataStart > entry.dataEnd
+               || entry.sizeInArchive() >= COALESCELIMIT;
+    };
+
+    PooledBuffer pooledRun;
+    std::unique_ptr<unsigned char[]> largeRun;
+    uint64_t largeRunSize = 0;
+
+    for (size_t first = 0; first < order.size();) {
+        const EntryRecord& firstEntry = *entries[order[first]];
+
+        if (readAlone(firstEntry)) {
+            sizes[order[first]] = getFileFromEntry(firstEntry, buffers[order[first]]);
+            ++first;
+            continue;
+        }
+
+        // Extend the run over every following file that starts soon enough after it, up to the limit
+        uint64_t runStart = firstEntry.dataStart;
+        uint64_t runEnd = firstEntry.dataEnd;
+        size_t last = first + 1;
+        for (; last < order.size(); ++last) {
+            const EntryRecord& entry = *entries[order[last]];
+            if (readAlone(entry) || entry.dataStart > runEnd + COALESCEGAP) break;
+            if (std::max(runEnd, entry.dataEnd) - runStart > COALESCELIMIT) break;
+
+            runEnd = std::max(runEnd, entry.dataEnd);
+        }
+
+        unsigned char* run = pooledRun.get();
+        if (runEnd - runStart > CHUNKSIZE) {
+            if (runEnd - runStart > largeRunSize) {
+                largeRunSize = runEnd - runStart;
+                largeRun.reset(new unsigned char[largeRunSize]);
+            }
+            run = largeRun.get();
+        }
+
+        if (runEnd <= tableOffset && readFromArchive(runStart, reinterpret_cast<char*>(run), runEnd - runStart)) {
+            for (size_t i = first; i < last; ++i) {
+                const EntryRecord& entry = *entries[order[i]];
+                sizes[order[i]] = getFileFromMemory(entry, run + (entry.dataStart - runStart), buffers[order[i]]);
+
+                if (sizes[order[i]] == entry.originalSize) addFileToCache(entry, buffers[order[i]], entry.originalSize);
+            }
+
+            if (options.dropAfterRead) adviseRange(runStart, runEnd - runStart, Advice::DONTNEED);
+        }
+
+        first = last;
+    }
+
+    return sizes;
+}
+
+uint64_t DatArchive::DatArchiveReader::getFileFromMemory(const DatArchive::EntryRecord& entry,
+                                                         const unsigned char* source, char* buffer) const {
+    switch (entry.compressionMethod) {
+        case CompressionMethod::NONE:
+            if (calculateCrc(source, entry.sizeInArchive()) != entry.crc32) return 0;
+
+            memcpy(buffer, source, entry.sizeInArchive());
+            return entry.sizeInArchive();
+        case CompressionMethod::ZLIB:
+            return zlibInflateBuffer(entry, source, buffer, true);
+        default:
+            return 0;
+    }
+}
+
+bool DatArchive::DatArchiveReader::extractEntry(const DatArchive::EntryRecord& entry,
+                                                const std::filesystem::path& destination, bool overwrite) const {
+    int fd = open(destination.c_str(), O_WRONLY | O_CREAT | (overwrite ? O_TRUNC : O_EXCL), 0666);
+    if (fd < 0) return !overwrite && errno == EEXIST;
+
+#ifdef __linux__
+    // Allocating the whole file up front keeps it in one piece on disk. File systems that can't do it natively just
+    // fail, unlike posix_fallocate() which would write every block first, and the file is written normally anyway
+    if (entry.originalSize > 0) fallocate(fd, 0, 0, (off_t) entry.originalSize);
+#endif
+
+    bool success;
+    if (entry.originalSize == 0) {
+        success = true;
+    } else if (entry.originalSize <= EXTRACTBUFFERLIMIT) {
+        PooledBuffer pooledBuffer;
+        std::unique_ptr<char[]> largeBuffer;
+
+        char* buffer = reinterpret_cast<char*>(pooledBuffer.get());
+        if (entry.originalSize > CHUNKSIZE) {
+            largeBuffer.reset(new char[entry.originalSize]);
+            buffer = largeBuffer.get();
+        }
+
+        success = getFileFromEntry(entry, buffer) == entry.originalSize && writeAll(fd, buffer, entry.originalSize);
+    } else {
+        EntryStream entryStream(*this, entry, true);
+        PooledBuffer buffer;
+
+        size_t have;
+        success = true;
+        while (success && (have = entryStream.read(reinterpret_cast<char*>(buffer.get()), CHUNKSIZE)) > 0) {
+            success = writeAll(fd, reinterpret_cast<char*>(buffer.get()), have);
+        }
+
+        success = success && entryStream.getState() == EntryStream::State::FINISHED;
+
+        // Smaller files are let go of as they are extracted, this one was streamed around that
+        if (options.dropAfterRead) adviseRange(entry.dataStart, entry.sizeInArchive(), Advice::DONTNEED);
+    }
+
+    if (close(fd) != 0) success = false;
+
+    // Don't leave a damaged or partial file behind
+    if (!success) unlink(destination.c_str());
+
+    return success;
+}
+
+uint32_t DatArchive::DatArchiveReader::calculateCrc(const unsigned char* data, uint64_t size) const {
+    // Large files are split between the threads of the pool, if there is one
+    if (threadPool != nullptr && size >= 2 * PARALLELCRCSLICESIZE) return parallelCrc32(0, data, size, *threadPool);
+
+    return fastCrc32(0, data, size);
+}
+
+uint64_t DatArchive::DatArchiveReader::extractFile(const DatArchive::EntryRecord& entry, char* buffer, bool validateCrc) const {
+    if (mappedArchive != nullptr) {
+        if (entry.dataStart > entry.dataEnd || entry.dataEnd > mappedSize) return 0;
+
+        // An empty file may be extracted into an empty vector's data, which can be null
+        if (entry.sizeInArchive() == 0) return 0;
+
+        const auto* source = reinterpret_cast<const unsigned char*>(mappedArchive + entry.dataStart);
+        if (validateCrc && calculateCrc(source, entry.sizeInArchive()) != entry.crc32) return 0;
+
+        memcpy(buffer, source, entry.sizeInArchive());
+        return entry.sizeInArchive();
+    }
+
+    if (entry.dataStart > entry.dataEnd) return 0;
+    if (!readFromArchive(entry.dataStart, buffer, entry.sizeInArchive())) return 0;
+
+    if (validateCrc && calculateCrc(reinterpret_cast<unsigned char*>(buffer), entry.sizeInArchive()) != entry.crc32) {
+        return 0;
+    }
+
+    return entry.sizeInArchive();
+}
+
+uint64_t
+DatArchive::DatArchiveReader::zlibExtractFile(const DatArchive::EntryRecord& entry, char* buffer, bool validateCrc) const {
+    // Large files are split between the threads of the pool, if that was asked for and there are enough cores
+    uint64_t parallelSize;
+    if (inflateInParallel && entry.dataStart <= entry.dataEnd
+        && entry.sizeInArchive() >= 2 * PARALLELINFLATECHUNKSIZE
+        && parallelZlibExtractFile(entry, buffer, validateCrc, parallelSize)) {
+        return parallelSize;
+    }
+
+    if (mappedArchive != nullptr) {
+        if (entry.dataStart > entry.dataEnd || entry.dataEnd > mappedSize) return 0;
+
+        // Inflate straight out of the mapping, there is no need to stage the file through a buffer
+        return zlibInflateBuffer(entry, reinterpret_cast<const unsigned char*>(mappedArchive + entry.dataStart),
+                                 buffer, validateCrc);
+    }
+
+    if (entry.dataStart > entry.dataEnd) return 0;
+
+    // Small files are read whole and inflated in one go, which saves zlib keeping a copy of the output as it goes
+    if (entry.sizeInArchive() <= options.singleShotInflateLimit) {
+        PooledBuffer pooledSource;
+        std::unique_ptr<unsigned char[]> largeSource;
+
+        unsigned char* source = pooledSource.get();
+        if (entry.sizeInArchive() > CHUNKSIZE) {
+            largeSource.reset(new unsigned char[entry.sizeInArchive()]);
+            source = largeSource.get();
+        }
+
+        if (!readFromArchive(entry.dataStart, reinterpret_cast<char*>(source), entry.sizeInArchive())) return 0;
+
+        return zlibInflateBuffer(entry, source, buffer, validateCrc);
+    }
+
+    int rc;
+
+    // Both are borrowed from this thread's cache, so small files don't pay to set them up every time
+    PooledInflater inflater;
+    if (!inflater.valid()) return 0;
+
+    z_stream& strm = inflater.stream();
+    strm.next_out = reinterpret_cast<unsigned char*>(buffer);
+
+    PooledBuffer pooledIn;
+    unsigned char* in = pooledIn.get();
+
+    uint32_t calculatedCrc = 0;
+
+    uint64_t position = entry.dataStart;
+    uint64_t remainingOut = entry.originalSize;
+    do {
+        if (strm.avail_in == 0) {
+            uint64_t availableBytes = std::min<uint64_t>(CHUNKSIZE, entry.dataEnd - position);
+
+            if (!readFromArchive(position, reinterpret_cast<char*>(in), availableBytes)) return 0;
+            position += availableBytes;
+            strm.avail_in = availableBytes;
+            strm.next_in = in;
+
+            calculatedCrc = fastCrc32(calculatedCrc, in, availableBytes);
+        }
+
+        // zlib counts in unsigned ints, so very large files have to be written out in pieces
+        if (strm.avail_out == 0 && remainingOut > 0) {
+            strm.avail_out = std::min<uint64_t>(remainingOut, UINT_MAX);
+            remainingOut -= strm.avail_out;
+        }
+
+        rc = inflate(&strm, Z_NO_FLUSH);
+        switch (rc) {
+            case Z_BUF_ERROR:
+            case Z_STREAM_ERROR:
+            case Z_NEED_DICT:
+            case Z_DATA_ERROR:
+            case Z_MEM_ERROR:
+                return 0;
+        }
+    } while (rc != Z_STREAM_END);
+
+    if (validateCrc && calculatedCrc != entry.crc32) return 0;
+
+    return entry.originalSize;
+}
+
+uint64_t DatArchive::DatArchiveReader::zlibInflateBuffer(const DatArchive::EntryRecord& entry,
+                                                         const unsigned char* source, char* buffer,
+                                                         bool validateCrc) {
+    uint64_t remainingIn = entry.sizeInArchive();
+    uint64_t remainingOut = entry.originalSize;
+
+    if (validateCrc && fastCrc32(0, source, remainingIn) != entry.crc32) return 0;
+
+    int rc;
+
+    PooledInflater inflater;
+    if (!inflater.valid()) return 0;
+
+    z_stream& strm = inflater.stream();
+    strm.next_out = reinterpret_cast<unsigned char*>(buffer);
+
+    do {
+        // zlib counts in unsigned ints, so very large files have to be fed through in pieces
+        if (strm.avail_in == 0 && remainingIn > 0) {
+            strm.avail_in = std::min<uint64_t>(remainingIn, UINT_MAX);
+            strm.next_in = const_cast<unsigned char*>(source);
+            source += strm.avail_in;
+            remainingIn -= strm.avail_in;
+        }
+        if (strm.avail_out == 0 && remainingOut > 0) {
+            strm.avail_out = std::min<uint64_t>(remainingOut, UINT_MAX);
+            remainingOut -= strm.avail_out;
+        }
+
+        // Finishing once everything has been handed over lets zlib skip keeping a copy of the output
+        rc = inflate(&strm, remainingIn == 0 && remainingOut == 0 ? Z_FINISH : Z_NO_FLUSH);
+    } while (rc == Z_OK);
+
+    if (rc != Z_STREAM_END) return 0;
+
+    return entry.originalSize;
+}
+
+bool DatArchive::DatArchiveReader::parallelZlibExtractFile(const DatArchive::EntryRecord& entry, char* buffer,
+                                                           bool validateCrc, uint64_t& size) const {
+    const unsigned char* source;
+
+    // Map just this file while it is inflated, so the threads can all read it without taking turns
+    const std::byte* mapping = nullptr;
+    uint64_t mappingSize = 0;
+    if (mappedArchive != nullptr) {
+        if (entry.dataEnd > mappedSize) return false;
+
+        source = reinterpret_cast<const unsigned char*>(mappedArchive + entry.dataStart);
+    } else {
+        mapping = mapFile(archivePath, entry.dataStart, mappingSize);
+        if (mapping == nullptr) return false;
+
+        source = reinterpret_cast<const unsigned char*>(mapping + entry.dataStart % sysconf(_SC_PAGESIZE));
+    }
+
+    uint32_t calculatedCrc;
+    bool inflated = parallelInflate(source, entry.sizeInArchive(), reinterpret_cast<unsigned char*>(buffer),
+                                    entry.originalSize, *threadPool, calculatedCrc);
+    unmapFile(mapping, mappingSize);
+
+    if (!inflated) return false;
+
+    size = validateCrc && calculatedCrc != entry.crc32 ? 0 : entry.originalSize;
+    return true;
+}
+
+uint64_t DatArchive::DatArchiveReader::zlibBlocksExtractFile(const DatArchive::EntryRecord& entry, char* buffer,
+                                                             bool validateCrc) const {
+    std::vector<uint64_t> blockEnds;
+    uint32_t blockSize;
+    if (!readBlockTable(entry, blockEnds, blockSize)) return 0;
+
+    // Blocks are read one at a time when the archive isn't mapped, so only the largest needs to fit in memory
+    std::unique_ptr<unsigned char[]> in;
+    if (mappedArchive == nullptr) {
+        uint64_t largestBlock = 0;
+        for (size_t block = 0; block < blockEnds.size(); ++block) {
+            largestBlock = std::max(largestBlock, blockEnds[block] - (block == 0 ? 0 : blockEnds[block - 1]));
+        }
+        in.reset(new unsigned char[largestBlock]);
+    }
+
+    // One inflate state is reset for each block, rather than setting up a new one each time
+    PooledInflater inflater;
+    if (!inflater.valid()) return 0;
+
+    z_stream& strm = inflater.stream();
+
+    uint32_t calculatedCrc = 0;
+
+    uint64_t blockStart = 0;
+    for (size_t block = 0; block < blockEnds.size(); ++block) {
+        uint64_t compressedSize = blockEnds[block] - blockStart;
+
+        const unsigned char* source = in.get();
+        if (mappedArchive != nullptr) {
+            source = reinterpret_cast<const unsigned char*>(mappedArchive + entry.dataStart + blockStart);
+        } else if (!readFromArchive(entry.dataStart + blockStart, reinterpret_cast<char*>(in.get()), compressedSize)) {
+            return 0;
+        }
+
+        if (validateCrc) calculatedCrc = fastCrc32(calculatedCrc, source, compressedSize);
+
+        // Each block is a complete zlib stream, so it can be inflated in one go straight into place
+        uint64_t originalStart = block * blockSize;
+        uint64_t expectedSize = std::min<uint64_t>(blockSize, entry.originalSize - originalStart);
+        if (compressedSize > UINT_MAX || inflateReset(&strm) != Z_OK) return 0;
+
+        strm.next_in = const_cast<unsigned char*>(source);
+        strm.avail_in = compressedSize;
+        strm.next_out = reinterpret_cast<unsigned char*>(buffer + originalStart);
+        strm.avail_out = expectedSize;
+
+        int rc = inflate(&strm, Z_FINISH);
+        if (rc != Z_STREAM_END || strm.avail_out != 0 || strm.avail_in != 0) return 0;
+
+        blockStart = blockEnds[block];
+    }
+
+    if (validateCrc) {
+        // The CRC also covers the block table
+        BlockTableFooter footer{blockSize, (uint32_t) blockEnds.size()};
+        calculatedCrc = fastCrc32(calculatedCrc, reinterpret_cast<const unsigned char*>(blockEnds.data()),
+                                  blockEnds.size() * sizeof(uint64_t));
+        calculatedCrc = fastCrc32(calculatedCrc, reinterpret_cast<const unsigned char*>(&footer), sizeof(footer));
+
+        if (calculatedCrc != entry.crc32) return 0;
+    }
+
+    return entry.originalSize;
+}
+
+bool DatArchive::DatArchiveReader::readBlockTable(const DatArchive::EntryRecord& entry,
+                                                  std::vector<uint64_t>& blockEnds, uint32_t& blockSize) const {
+    if (entry.dataStart > entry.dataEnd || entry.dataEnd > tableOffset) return false;
+
+    uint64_t storedSize = entry.sizeInArchive();
+
+    BlockTableFooter footer{};
+    if (storedSize < sizeof(footer)) return false;
+    if (!readFromArchive(entry.dataEnd - sizeof(footer), reinterpret_cast<char*>(&footer), sizeof(footer))) {
+        return false;
+    }
+
+    // The number of blocks follows from the size of the file, which catches most damaged footers
+    if (footer.blockSize == 0 && entry.originalSize > 0) return false;
+
+    uint64_t expectedCount = entry.originalSize == 0 ? 0 : (entry.originalSize - 1) / footer.blockSize + 1;
+    if (footer.blockCount != expectedCount) return false;
+
+    uint64_t tableSize = footer.blockCount * sizeof(uint64_t) + sizeof(footer);
+    if (tableSize > storedSize) return false;
+
+    blockEnds.resize(footer.blockCount);
+    if (footer.blockCount > 0 && !readFromArchive(entry.dataEnd - tableSize, reinterpret_cast<char*>(blockEnds.data()),
+                                                  footer.blockCount * sizeof(uint64_t))) {
+        return false;
+    }
+
+    // The blocks must follow each other with no gaps, and finish where the table begins
+    uint64_t previousEnd = 0;
+    for (uint64_t blockEnd: blockEnds) {
+        if (blockEnd <= previousEnd) return false;
+        previousEnd = blockEnd;
+    }
+    if (previousEnd != storedSize - tableSize) return false;
+
+    blockSize = footer.blockSize;
+    return true;
+}
+
+std::shared_ptr<const std::vector<DatArchive::InflateCheckpoint>>
+DatArchive::DatArchiveReader::findCheckpoints(const DatArchive::EntryRecord& entry) const {
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+
+    auto found = checkpoints.find(entry.dataStart);
+    if (found == checkpoints.end()) return nullptr;
+
+    return found->second;
+}
+
+std::shared_ptr<const std::vector<DatArchive::InflateCheckpoint>>
+DatArchive::DatArchiveReader::buildCheckpoints(const DatArchive::EntryRecord& entry, uint64_t spacing) const {
+    if (entry.compressionMethod != CompressionMethod::ZLIB) return nullptr;
+    if (entry.dataStart > entry.dataEnd || entry.dataEnd > tableOffset) return nullptr;
+
+    int rc;
+
+    PooledInflater inflater;
+    if (!inflater.valid()) return nullptr;
+
+    z_stream& strm = inflater.stream();
+    PooledBuffer in;
+
+    // The output is written round and round the window, so it always holds the most recent part of the file
+    std::unique_ptr<unsigned char[]> window(new unsigned char[INFLATEWINDOWSIZE]());
+
+    auto built = std::make_shared<std::vector<InflateCheckpoint>>();
+    uint32_t calculatedCrc = 0;
+
+    uint64_t position = entry.dataStart;
+    uint64_t totalIn = 0;
+    uint64_t totalOut = 0;
+    uint64_t lastCheckpoint = 0;
+    do {
+        if (strm.avail_in == 0) {
+            uint64_t availableBytes = std::min<uint64_t>(CHUNKSIZE, entry.dataEnd - position);
+
+            if (availableBytes == 0 || !readFromArchive(position, reinterpret_cast<char*>(in.get()), availableBytes)) {
+                return nullptr;
+            }
+            position += availableBytes;
+            strm.avail_in = availableBytes;
+            strm.next_in = in.get();
+
+            calculatedCrc = fastCrc32(calculatedCrc, in.get(), availableBytes);
+        }
+
+        if (strm.avail_out == 0) {
+            strm.avail_out = INFLATEWINDOWSIZE;
+            strm.next_out = window.get();
+        }
+
+        // Z_BLOCK stops at the end of every deflate block, the only places inflating can resume from
+        totalIn += strm.avail_in;
+        totalOut += strm.avail_out;
+        rc = inflate(&strm, Z_BLOCK);
+        totalIn -= strm.avail_in;
+        totalOut -= strm.avail_out;
+
+        if (rc != Z_OK && rc != Z_STREAM_END) return nullptr;
+
+        // Bit 7 of data_type is set at the end of a block, bit 6 as well if it was the last block
+        bool blockBoundary = (strm.data_type & 128) != 0 && (strm.data_type & 64) == 0;
+
+        if (rc == Z_OK && blockBoundary && (built->empty() || totalOut - lastCheckpoint >= spacing)) {
+            InflateCheckpoint& checkpoint = built->emplace_back();
+            checkpoint.compressedOffset = totalIn;
+            checkpoint.originalOffset = totalOut;
+            checkpoint.bits = strm.data_type & 7;
+
+            // Unwrap the window so it runs from oldest to newest
+            size_t left = strm.avail_out;
+            checkpoint.window.resize(INFLATEWINDOWSIZE);
+            memcpy(checkpoint.window.data(), window.get() + INFLATEWINDOWSIZE - left, left);
+            memcpy(checkpoint.window.data() + left, window.get(), INFLATEWINDOWSIZE - left);
+
+            lastCheckpoint = totalOut;
+        }
+    } while (rc != Z_STREAM_END);
+
+    // The whole file has been read, so a damaged file can be caught before its checkpoints are trusted
+    if (totalOut != entry.originalSize || calculatedCrc != entry.crc32) return nullptr;
+
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    checkpoints[entry.dataStart] = built;
+
+    return built;
+}
+
+DatArchive::DatArchiveReader::DatArchiveReader(const std::filesystem::path& archiveFilePath,
+                                               ReaderOptions options) : archivePath(archiveFilePath) {
+    openArchive(archiveFilePath, options);
+}
+
+DatArchive::DatArchiveReader::~DatArchiveReader() {
+    closeArchive();
+}
+
+bool DatArchive::DatArchiveReader::openArchive(const std::filesystem::path& archiveFilePath,
+                                               ReaderOptions options) {
+    if (openFlag) closeArchive();
+
+    openFlag = false;
+    badFlag = false;
+    archivePath = archiveFilePath;
+    this->options = options;
+
+    if (!exists(archiveFilePath) && !is_directory(archiveFilePath)) {
+        return false;
+    }
+    archive.open(archiveFilePath, std::ios::in | std::ios::binary);
+
+    if (!archive) {
+        return false;
+    }
+    openFlag = true;
+
+    char signature[4];
+
+    archive.read(signature, 4);
+    archive.read(reinterpret_cast<char*>(&archiveVersion), 1);
+
+    if (!validateArchive(signature, archiveVersion)) {
+        badFlag = true;
+        return false;
+    }
+
+    archive.read(reinterpret_cast<char*>(&tableOffset), 8);
+    archiveSize = file_size(archiveFilePath);
+
+    if (options.readMode == ReadMode::MAPPED && !mapArchive()) {
+        badFlag = true;
+        return false;
+    }
+
+    if (options.readMode == ReadMode::POSITIONAL) {
+        archiveDescriptor = open(archiveFilePath.c_str(), O_RDONLY);
+
+        if (archiveDescriptor < 0) {
+            badFlag = true;
+            return false;
+        }
+    } else {
+        // Hints are only advice, so the archive can still be read without them
+        hintDescriptor = open(archiveFilePath.c_str(), O_RDONLY);
+    }
+
+    if (!loadTable()) {
+        badFlag = true;
+        return false;
+    }
+
+    if (options.threadCount != 1) threadPool = std::make_unique<ThreadPool>(options.threadCount);
+    inflateInParallel = options.parallelInflate && threadPool != nullptr
+                        && threadPool->size() >= PARALLELINFLATEMINIMUMTHREADS
+                        && std::thread::hardware_concurrency() >= PARALLELINFLATEMINIMUMTHREADS;
+    if (options.cacheSize > 0) cache = std::make_unique<EntryCache>(options.cacheSize);
+
+    if (options.accessPattern == AccessPattern::SEQUENTIAL) adviseRange(0, 0, Advice::SEQUENTIAL);
+    else if (options.accessPattern == AccessPattern::RANDOM) adviseRange(0, 0, Advice::RANDOM);
+
+    return true;
+}
+
+bool DatArchive::DatArchiveReader::closeArchive() {
+    if (!openFlag) return false;
+
+    // Let every asynchronous read finish, outside the lock in case a callback starts another
+    std::unique_ptr<UringReader> closingUring;
+    std::unique_ptr<ThreadPool> closingPool;
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+        closingUring = std::move(uringReader);
+        closingPool = std::move(asyncPool);
+    }
+    closingUring.reset();
+    closingPool.reset();
+    archive.close();
+    unmapArchive();
+    threadPool.reset();
+    inflateInParallel = false;
+    cache.reset();
+
+    if (archiveDescriptor >= 0) {
+        close(archiveDescriptor);
+        archiveDescriptor = -1;
+    }
+
+    if (hintDescriptor >= 0) {
+        close(hintDescriptor);
+        hintDescriptor = -1;
+    }
+
+    // The table may have been a view into one of the mappings
+    entries = {};
+    nameArena = {};
+    entryStorage.clear();
+    nameStorage.clear();
+    entryIndex.clear();
+    sortedTable = false;
+
+    {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        nameOrder.clear();
+        nameOrderBuilt = false;
+        dataOrder.clear();
+        dataOrderBuilt = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        checkpoints.clear();
+    }
+
+    openFlag = false;
+    return true;
+}
+
+size_t DatArchive::DatArchiveReader::size() const {
+    return entries.size();
+}
+
+bool DatArchive::DatArchiveReader::contains(std::string_view name) const {
+    return findEntry(name) != nullptr;
+}
+
+std::vector<std::string> DatArchive::DatArchiveReader::listFiles() const {
+    std::vector<std::string> keys;
+    keys.reserve(entries.size());
+
+    // Extract names from entries
+    for (const EntryRecord& entry: entries) {
+        keys.emplace_back(entry.name(nameArena));
+    }
+
+    return keys;
+}
+
+std::vector<DatArchive::DirectoryEntry> DatArchive::DatArchiveReader::listDirectory(std::string_view directory) const {
+    if (!openFlag || badFlag) return {};
+    buildNameOrder();
+
+    std::string prefix(directory);
+    if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+
+    auto [position, last] = prefixRange(prefix);
+
+    std::vector<DirectoryEntry> listing;
+    while (position < last) {
+        std::string_view name = nameInOrder(position);
+
+        size_t split = name.find('/', prefix.size());
+        if (split == std::string_view::npos) {
+            listing.push_back({name, false});
+            ++position;
+            continue;
+        }
+
+        // Everything in the subdirectory comes next, so it is all skipped over at once
+        std::string_view subdirectory = name.substr(0, split + 1);
+        listing.push_back({subdirectory, true});
+
+        position = partitionPoint(position, last, [this, subdirectory](size_t position) {
+            return nameInOrder(position).starts_with(subdirectory);
+        });
+    }
+
+    return listing;
+}
+
+std::vector<std::string_view> DatArchive::DatArchiveReader::listDirectoryRecursive(std::string_view directory) const {
+    if (!openFlag || badFlag) return {};
+    buildNameOrder();
+
+    std::string prefix(directory);
+    if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+
+    auto [first, last] = prefixRange(prefix);
+
+    std::vector<std::string_view> names;
+    names.reserve(last - first);
+    for (size_t position = first; position < last; ++position) names.push_back(nameInOrder(position));
+
+    return names;
+}
+
+std::vector<std::string_view> DatArchive::DatArchiveReader::matchFiles(std::string_view pattern) const {
+    if (!openFlag || badFlag) return {};
+    buildNameOrder();
+
+    auto [first, last] = prefixRange(literalPrefix(pattern));
+
+    std::vector<std::string_view> names;
+    for (size_t position = first; position < last; ++position) {
+        std::string_view name = nameInOrder(position);
+        if (globMatch(pattern, name)) names.push_back(name);
+    }
+
+    return names;
+}
+
+std::vector<char> DatArchive::DatArchiveReader::getFile(std::string_view name) const {
+    if (!openFlag || badFlag) return {};
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return {};
+
+    std::vector<char> dest(entry->originalSize);
+
+    if (getFileFromEntry(*entry, dest.data())) return dest;
+    else return {};
+}
+
+std::vector<std::vector<char>> DatArchive::DatArchiveReader::getFiles(std::span<const std::string_view> names) const {
+    if (!openFlag || badFlag) return std::vector<std::vector<char>>(names.size());
+
+    std::vector<const EntryRecord*> entries(names.size());
+    std::vector<std::vector<char>> files(names.size());
+    std::vector<char*> buffers(names.size());
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        entries[i] = findEntry(names[i]);
+        if (entries[i] == nullptr) continue;
+
+        files[i].resize(entries[i]->originalSize);
+        buffers[i] = files[i].data();
+    }
+
+    std::vector<uint64_t> sizes = getFilesFromEntries(entries, buffers);
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (sizes[i] == 0) files[i] = {};
+    }
+
+    return files;
+}
+
+std::vector<uint64_t> DatArchive::DatArchiveReader::getFilesRaw(std::span<const std::string_view> names,
+                                                                std::span<char* const> buffers) const {
+    if (!openFlag || badFlag || buffers.size() < names.size()) return std::vector<uint64_t>(names.size(), 0);
+
+    std::vector<const EntryRecord*> entries(names.size());
+    for (size_t i = 0; i < names.size(); ++i) entries[i] = findEntry(names[i]);
+
+    return getFilesFromEntries(entries, buffers);
+}
+
+uint64_t DatArchive::DatArchiveReader::getFileRaw(std::string_view name, char* buffer) const {
+    if (!openFlag || badFlag) return 0;
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return 0;
+
+    return getFileFromEntry(*entry, buffer);
+}
+
+std::span<const std::byte> DatArchive::DatArchiveReader::getFileView(std::string_view name, bool validateCrc) const {
+    if (!openFlag || badFlag || mappedArchive == nullptr) return {};
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return {};
+
+    if (entry->compressionMethod != CompressionMethod::NONE) return {};
+    if (entry->dataStart > entry->dataEnd || entry->dataEnd > mappedSize) return {};
+
+    std::span<const std::byte> view(mappedArchive + entry->dataStart, entry->sizeInArchive());
+
+    if (validateCrc && calculateCrc(reinterpret_cast<const unsigned char*>(view.data()), view.size()) != entry->crc32) {
+        return {};
+    }
+
+    return view;
+}
+
+bool DatArchive::DatArchiveReader::extractAll(const std::filesystem::path& destination,
+                                              DatArchive::ExtractOptions extractOptions) const {
+    if (!openFlag || badFlag) return false;
+
+    bool success = true;
+
+    // Work out where everything goes first, so each directory is only created once and before any thread needs it
+    std::vector<std::pair<const EntryRecord*, std::filesystem::path>> files;
+    files.reserve(entries.size());
+    std::vector<std::filesystem::path> directories;
+
+    for (const EntryRecord& entry: entries) {
+        std::filesystem::path relativePath;
+        if (!relativeExtractPath(entry.name(nameArena), relativePath)) {
+            success = false;
+            continue;
+        }
+
+        files.emplace_back(&entry, destination / relativePath);
+        directories.push_back(files.back().second.parent_path());
+    }
+
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+
+    for (const std::filesystem::path& directory: directories) {
+        std::error_code error;
+        create_directories(directory, error);
+    }
+
+    // Extract in the order the files are stored, so the archive is read from start to end
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.first->dataStart < b.first->dataStart;
+    });
+
+    ThreadPool pool(extractOptions.threadCount);
+
+    std::vector<std::future<bool>> extracted;
+    extracted.reserve(files.size());
+    for (const auto& [entry, path]: files) {
+        extracted.push_back(pool.submit([this, entry = entry, &path = path, &extractOptions]() {
+            return extractEntry(*entry, path, extractOptions.overwrite);
+        }));
+    }
+
+    for (std::future<bool>& file: extracted) {
+        if (!file.get()) success = false;
+    }
+
+    return success;
+}
+
+void DatArchive::DatArchiveReader::startAsyncReads(UringReader*& uring, ThreadPool*& pool) const {
+    std::lock_guard<std::mutex> lock(asyncMutex);
+
+    if (asyncPool == nullptr) {
+        asyncPool = std::make_unique<ThreadPool>(0);
+        if (options.asyncQueueDepth > 0) uringReader = UringReader::create(archivePath, options.asyncQueueDepth);
+    }
+
+    uring = uringReader.get();
+    pool = asyncPool.get();
+}
+
+void DatArchive::DatArchiveReader::readFileAsync(std::string_view name, ReadCallback callback) const {
+    const EntryRecord* found = openFlag && !badFlag ? findEntry(name) : nullptr;
+    if (found == nullptr) {
+        callback({});
+        return;
+    }
+
+    EntryRecord entry = *found;
+
+    UringReader* uring;
+    ThreadPool* pool;
+    startAsyncReads(uring, pool);
+
+    // Cached files are only copied, which is still left to the pool so the callback runs in the same place
+    std::shared_ptr<const std::vector<char>> cached;
+    if (cache != nullptr && cache->fits(entry.originalSize)) cached = cache->find(entry);
+
+    if (cached != nullptr) {
+        pool->submit([cached, callback = std::move(callback)]() { callback(*cached); });
+        return;
+    }
+
+    // io_uring only reads the stored data in one go, anything needing more than that is left to the pool
+    bool singleRead = entry.dataStart <= entry.dataEnd && entry.dataEnd <= tableOffset
+                      && (entry.compressionMethod == CompressionMethod::NONE
+                          || (entry.compressionMethod == CompressionMethod::ZLIB
+                              && entry.sizeInArchive() < COALESCELIMIT));
+
+    if (uring != nullptr && singleRead) {
+        uring->read(entry.dataStart, entry.sizeInArchive(), [this, entry, pool, callback = std::move(callback)]
+                (bool success, std::vector<char> stored) {
+            // Hand the data over to the pool, the completion thread has other reads to see to
+            pool->submit([this, entry, success, callback, stored = std::move(stored)]() mutable {
+                if (!success) {
+                    // The ring may have stopped taking reads, so the file is extracted the usual way instead
+                    std::vector<char> file(entry.originalSize);
+                    if (extractFromEntry(entry, file.data(), true) == 0) file = {};
+                    else addFileToCache(entry, file.data(), file.size());
+
+                    callback(std::move(file));
+                } else if (entry.compressionMethod == CompressionMethod::NONE) {
+                    // The data read is the file, so it can be handed over as it is
+                    auto data = reinterpret_cast<const unsigned char*>(stored.data());
+                    if (calculateCrc(data, stored.size()) != entry.crc32) stored = {};
+                    else addFileToCache(entry, stored.data(), stored.size());
+
+                    callback(std::move(stored));
+                } else {
+                    std::vector<char> file(entry.originalSize);
+                    auto data = reinterpret_cast<const unsigned char*>(stored.data());
+                    if (getFileFromMemory(entry, data, file.data()) == 0) file = {};
+                    else addFileToCache(entry, file.data(), file.size());
+
+                    callback(std::move(file));
+                }
+            });
+        });
+        return;
+    }
+
+    // The cache has already been checked, so the file is extracted directly
+    pool->submit([this, entry, callback = std::move(callback)]() {
+        std::vector<char> file(entry.originalSize);
+        if (extractFromEntry(entry, file.data(), true) == 0) file = {};
+        else addFileToCache(entry, file.data(), file.size());
+
+        callback(std::move(file));
+    });
+}
+
+std::future<std::vector<char>> DatArchive::DatArchiveReader::readFileAsync(std::string_view name) const {
+    auto promise = std::make_shared<std::promise<std::vector<char>>>();
+    std::future<std::vector<char>> file = promise->get_future();
+
+    readFileAsync(name, [promise](std::vector<char> read) { promise->set_value(std::move(read)); });
+
+    return file;
+}
+
+bool DatArchive::DatArchiveReader::prefetch(std::span<const std::string_view> names) const {
+    if (!openFlag || badFlag) return false;
+
+    std::vector<const EntryRecord*> sorted;
+    sorted.reserve(names.size());
+    for (std::string_view name: names) {
+        const EntryRecord* entry = findEntry(name);
+        if (entry != nullptr) sorted.push_back(entry);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const EntryRecord* a, const EntryRecord* b) {
+        return a->dataStart < b->dataStart;
+    });
+
+    adviseWillNeed(sorted);
+
+    return true;
+}
+
+std::shared_ptr<const std::vector<char>> DatArchive::DatArchiveReader::getFileShared(std::string_view name) const {
+    if (!openFlag || badFlag) return nullptr;
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return nullptr;
+
+    // Empty files can't be told apart from failures by their size, and have nothing to check
+    if (entry->originalSize == 0) return std::make_shared<const std::vector<char>>();
+
+    if (cache != nullptr && cache->fits(entry->originalSize)) {
+        std::shared_ptr<const std::vector<char>> cached = cache->find(*entry);
+        if (cached != nullptr) return cached;
+    }
+
+    auto file = std::make_shared<std::vector<char>>(entry->originalSize);
+    if (extractFromEntry(*entry, file->data(), true) != entry->originalSize) return nullptr;
+
+    if (cache != nullptr) cache->insert(*entry, file);
+
+    return file;
+}
+
+DatArchive::ReadAwaitable<std::vector<char>> DatArchive::DatArchiveReader::getFileAsync(std::string_view name,
+                                                                                        Executor* executor) const {
+    // The name is copied, as the awaitable may not be awaited until after the caller's string is gone
+    return {[this, name = std::string(name)](ReadCallback done) { readFileAsync(name, std::move(done)); }, executor};
+}
+
+DatArchive::ReadAwaitable<uint64_t> DatArchive::DatArchiveReader::getFileRawAsync(std::string_view name, char* buffer,
+                                                                                  Executor* executor) const {
+    return {[this, name = std::string(name), buffer](std::function<void(uint64_t)> done) {
+        const EntryRecord* found = openFlag && !badFlag ? findEntry(name) : nullptr;
+        if (found == nullptr) {
+            done(0);
+            return;
+        }
+
+        UringReader* uring;
+        ThreadPool* pool;
+        startAsyncReads(uring, pool);
+
+        pool->submit([this, entry = *found, buffer, done = std::move(done)]() {
+            done(getFileFromEntry(entry, buffer));
+        });
+    }, executor};
+}
+
+DatArchive::EntryStream DatArchive::DatArchiveReader::openFile(std::string_view name, bool validateCrc) const {
+    if (!openFlag || badFlag) return {};
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return {};
+
+    return {*this, *entry, validateCrc};
+}
+
+bool DatArchive::DatArchiveReader::getFileToStream(std::string_view name, std::ostream& stream,
+                                                   bool validateCrc) const {
+    EntryStream entryStream = openFile(name, validateCrc);
+    PooledBuffer buffer;
+
+    size_t have;
+    while ((have = entryStream.read(reinterpret_cast<char*>(buffer.get()), CHUNKSIZE)) > 0) {
+        stream.write(reinterpret_cast<char*>(buffer.get()), (std::streamsize) have);
+        if (stream.fail()) return false;
+    }
+
+    return entryStream.getState() == EntryStream::State::FINISHED;
+}
+
+uint64_t DatArchive::DatArchiveReader::readRange(std::string_view name, uint64_t offset, uint64_t length,
+                                                 char* buffer) const {
+    if (!openFlag || badFlag) return 0;
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr || offset >= entry->originalSize) return 0;
+
+    length = std::min(length, entry->originalSize - offset);
+
+    if (entry->compressionMethod == CompressionMethod::NONE) {
+        if (entry->dataStart > entry->dataEnd || entry->dataEnd > tableOffset) return 0;
+        if (entry->sizeInArchive() != entry->originalSize) return 0;
+
+        return readFromArchive(entry->dataStart + offset, buffer, length) ? length : 0;
+    }
+
+    // Files compressed in blocks don't need checkpoints, skipping jumps straight to the right block
+    std::shared_ptr<const std::vector<InflateCheckpoint>> entryCheckpoints = findCheckpoints(*entry);
+    if (entryCheckpoints == nullptr && entry->compressionMethod == CompressionMethod::ZLIB
+        && options.checkpointSpacing > 0 && entry->originalSize > options.checkpointSpacing) {
+        entryCheckpoints = buildCheckpoints(*entry, options.checkpointSpacing);
+    }
+
+    // Start from the last checkpoint at or before the range, if there is one
+    const InflateCheckpoint* checkpoint = nullptr;
+    if (entryCheckpoints != nullptr) {
+        auto after = std::upper_bound(entryCheckpoints->begin(), entryCheckpoints->end(), offset,
+                                      [](uint64_t target, const InflateCheckpoint& candidate) {
+                                          return target < candidate.originalOffset;
+                                      });
+        if (after != entryCheckpoints->begin()) checkpoint = &*std::prev(after);
+    }
+
+    EntryStream entryStream = checkpoint != nullptr ? EntryStream(*this, *entry, *checkpoint)
+                                                    : EntryStream(*this, *entry, false);
+
+    uint64_t distance = offset - entryStream.tell();
+    if (entryStream.skip(distance) != distance) return 0;
+
+    uint64_t have = 0;
+    while (have < length) {
+        size_t read = entryStream.read(buffer + have, std::min<uint64_t>(length - have, UINT_MAX));
+        if (read == 0) break;
+
+        have += read;
+    }
+
+    return have;
+}
+
+bool DatArchive::DatArchiveReader::buildCheckpoints(std::string_view name, uint64_t spacing) const {
+    if (!openFlag || badFlag) return false;
+
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) return false;
+
+    return buildCheckpoints(*entry, spacing) != nullptr;
+}
+
+bool DatArchive::DatArchiveReader::saveCheckpoints(const std::filesystem::path& checkpointFilePath) const {
+    if (!openFlag) return false;
+
+    // Take a copy so the lock isn't held while writing, the checkpoints themselves are never modified
+    std::map<uint64_t, std::shared_ptr<const std::vector<InflateCheckpoint>>> saved;
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        saved = checkpoints;
+    }
+
+    // The records identify each file by where its data is, so look them up the same way
+    std::map<uint64_t, const EntryRecord*> entriesByData;
+    for (const EntryRecord& entry: entries) {
+        if (saved.contains(entry.dataStart)) entriesByData.emplace(entry.dataStart, &entry);
+    }
+
+    CheckpointFileHeader header{};
+    memcpy(header.signature, DATCHECKPOINTSIGNATURE, 4);
+    header.version = DATCHECKPOINTVERSION;
+    header.archiveSize = archiveSize;
+    header.tableOffset = tableOffset;
+    header.fileCount = entriesByData.size();
+
+    // Write to a temporary file first so other readers never see partially written checkpoints
+    std::filesystem::path temporaryPath = checkpointFilePath;
+    temporaryPath += ".tmp";
+
+    std::ofstream checkpointFile(temporaryPath, std::ios::binary | std::ios::trunc);
+    checkpointFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const auto& [dataStart, entry]: entriesByData) {
+        const std::vector<InflateCheckpoint>& fileCheckpoints = *saved[dataStart];
+
+        CheckpointFileRecord fileRecord{};
+        fileRecord.dataStart = entry->dataStart;
+        fileRecord.dataEnd = entry->dataEnd;
+        fileRecord.originalSize = entry->originalSize;
+        fileRecord.crc32 = entry->crc32;
+        fileRecord.checkpointCount = fileCheckpoints.size();
+        checkpointFile.write(reinterpret_cast<const char*>(&fileRecord), sizeof(fileRecord));
+
+        for (const InflateCheckpoint& checkpoint: fileCheckpoints) {
+            CheckpointRecord record{};
+            record.compressedOffset = checkpoint.compressedOffset;
+            record.originalOffset = checkpoint.originalOffset;
+            record.bits = checkpoint.bits;
+
+            checkpointFile.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            checkpointFile.write(reinterpret_cast<const char*>(checkpoint.window.data()), INFLATEWINDOWSIZE);
+        }
+    }
+    checkpointFile.close();
+
+    std::error_code error;
+    if (checkpointFile.fail()) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    std::filesystem::rename(temporaryPath, checkpointFilePath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool DatArchive::DatArchiveReader::loadCheckpoints(const std::filesystem::path& checkpointFilePath) {
+    if (!openFlag) return false;
+
+    std::ifstream checkpointFile(checkpointFilePath, std::ios::binary);
+    if (!checkpointFile.is_open()) return false;
+
+    CheckpointFileHeader header{};
+    checkpointFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    // The checkpoints are only usable if they were built for this exact archive
+    if (checkpointFile.fail()
+        || strncmp(DATCHECKPOINTSIGNATURE, header.signature, 4) != 0
+        || header.version != DATCHECKPOINTVERSION
+        || header.archiveSize != archiveSize
+        || header.tableOffset != tableOffset) {
+        return false;
+    }
+
+    std::map<uint64_t, const EntryRecord*> entriesByData;
+    for (const EntryRecord& entry: entries) entriesByData.emplace(entry.dataStart, &entry);
+
+    std::map<uint64_t, std::shared_ptr<const std::vector<InflateCheckpoint>>> loaded;
+    for (uint64_t file = 0; file < header.fileCount; ++file) {
+        CheckpointFileRecord fileRecord{};
+        checkpointFile.read(reinterpret_cast<char*>(&fileRecord), sizeof(fileRecord));
+        if (checkpointFile.fail()) return false;
+
+        auto fileCheckpoints = std::make_shared<std::vector<InflateCheckpoint>>();
+
+        for (uint64_t i = 0; i < fileRecord.checkpointCount; ++i) {
+            CheckpointRecord record{};
+            checkpointFile.read(reinterpret_cast<char*>(&record), sizeof(record));
+            if (checkpointFile.fail()) return false;
+
+            InflateCheckpoint& checkpoint = fileCheckpoints->emplace_back();
+            checkpoint.compressedOffset = record.compressedOffset;
+            checkpoint.originalOffset = record.originalOffset;
+            checkpoint.bits = record.bits;
+            checkpoint.window.resize(INFLATEWINDOWSIZE);
+
+            checkpointFile.read(reinterpret_cast<char*>(checkpoint.window.data()), INFLATEWINDOWSIZE);
+            if (checkpointFile.fail()) return false;
+
+            // Checkpoints have to lie inside the file and be in order for readRange() to search them
+            uint64_t compressedSize = fileRecord.dataEnd - fileRecord.dataStart;
+            if (record.bits > 7 || record.compressedOffset > compressedSize
+                || (record.bits > 0 && record.compressedOffset == 0)
+                || record.originalOffset > fileRecord.originalSize
+                || (i > 0 && record.originalOffset < (*fileCheckpoints)[i - 1].originalOffset)) {
+                return false;
+            }
+        }
+
+        // Skip files that have changed since the checkpoints were built
+        auto found = entriesByData.find(fileRecord.dataStart);
+        if (found == entriesByData.end()) continue;
+
+        const EntryRecord& entry = *found->second;
+        if (entry.compressionMethod != CompressionMethod::ZLIB || entry.dataEnd != fileRecord.dataEnd
+            || entry.originalSize != fileRecord.originalSize || entry.crc32 != fileRecord.crc32) {
+            continue;
+        }
+
+        loaded[fileRecord.dataStart] = std::move(fileCheckpoints);
+    }
+
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    loaded.merge(checkpoints);
+    checkpoints = std::move(loaded);
+
+    return true;
+}
+
+DatArchive::TableEntry DatArchive::DatArchiveReader::getFileEntry(std::string_view name) const {
+    const EntryRecord* entry = findEntry(name);
+    if (entry == nullptr) throw std::out_of_range("The archive does not contain \"" + std::string(name) + "\"");
+
+    return entry->toTableEntry(nameArena);
+}
+
+std::vector<DatArchive::TableEntry> DatArchive::DatArchiveReader::getTable() const {
+    std::vector<TableEntry> table;
+    table.reserve(entries.size());
+
+    for (const EntryRecord& entry: entries) {
+        table.push_back(entry.toTableEntry(nameArena));
+    }
+
+    return table;
+}
+
+DatArchive::EntryRange DatArchive::DatArchiveReader::entriesInTableOrder() const {
+    return {entries, nameArena, nullptr};
+}
+
+DatArchive::EntryRange DatArchive::DatArchiveReader::entriesByName() const {
+    buildNameOrder();
+
+    return {entries, nameArena, sortedTable ? nullptr : nameOrder.data()};
+}
+
+DatArchive::EntryRange DatArchive::DatArchiveReader::entriesByOffset() const {
+    buildDataOrder();
+
+    return {entries, nameArena, dataOrder.data()};
+}
+
+uint64_t DatArchive::DatArchiveReader::getTableOffset() const {
+    return tableOffset;
+}
+
+bool DatArchive::DatArchiveReader::isOpen() const {
+    return openFlag;
+}
+
+bool DatArchive::DatArchiveReader::isBad() const {
+    return badFlag;
+}
+
+DatArchive::PoolStats DatArchive::DatArchiveReader::getPoolStats() {
+    return readPoolCounters();
+}
+
+void DatArchive::DatArchiveReader::resetPoolStats() {
+    clearPoolCounters();
+}
+
+DatArchive::CacheStats DatArchive::DatArchiveReader::getCacheStats() const {
+    if (cache == nullptr) return {};
+
+    return cache->getStats();
+}
+
+void DatArchive::DatArchiveReader::resetCacheStats() const {
+    if (cache != nullptr) cache->resetStats();
+}
+
+/*
+ * EntryStream
+ */
+
+struct DatArchive::EntryStream::Inflater {
+    // Both are borrowed from the cache of the thread that opened the stream
+    PooledInflater pooled;
+    PooledBuffer pooledInput;
+
+    z_stream& strm;
+    unsigned char* input;
+
+    // The block table, only read once a file compressed in blocks is skipped through
+    bool blockTableRead = false;
+    std::vector<uint64_t> blockEnds;
+    uint32_t blockSize = 0;
+
+    explicit Inflater(int windowBits) : pooled(windowBits), strm(pooled.stream()), input(pooledInput.get()) {}
+};
+
+DatArchive::EntryStream::EntryStream() = default;
+
+DatArchive::EntryStream::EntryStream(const DatArchive::DatArchiveReader& reader, const DatArchive::EntryRecord& entry,
+                                     bool validateCrc) : reader(&reader), entry(entry), validateCrc(validateCrc),
+                                                         position(entry.dataStart) {
+    // All the data must sit between the header and the table
+    if (entry.dataStart > entry.dataEnd || entry.dataEnd > reader.tableOffset) return;
+
+    switch (entry.compressionMethod) {
+        case CompressionMethod::NONE:
+            break;
+        case CompressionMethod::ZLIB:
+        case CompressionMethod::ZLIB_BLOCKS:
+            inflater = std::make_unique<Inflater>(MAX_WBITS);
+            if (!inflater->pooled.valid()) return;
             break;
+        default:
+            return;
     }
 
-    return 0;
-}
+    state = State::READING;
 
-uint64_t DatArchive::DatArchiveReader::extractFile(const DatArchive::TableEntry& entry, char* buffer, bool validateCrc) {
-    archive.seekg(entry.dataStart);
-    archive.read(buffer, entry.sizeInArchive());
+    // An empty stored file has nothing to read, and an empty file in blocks is only its block table
+    if (entry.compressionMethod == CompressionMethod::NONE && entry.dataStart == entry.dataEnd) finish();
+    if (entry.compressionMethod == CompressionMethod::ZLIB_BLOCKS && entry.originalSize == 0) finish();
+}
 
-    uint32_t calculatedCrc = crc32(0, reinterpret_cast<unsigned char*>(buffer), entry.sizeInArchive());
+DatArchive::EntryStream::EntryStream(const DatArchive::DatArchiveReader& reader, const DatArchive::EntryRecord& entry,
+                                     const DatArchive::InflateCheckpoint& checkpoint)
+        : reader(&reader), entry(entry), validateCrc(false), position(entry.dataStart + checkpoint.compressedOffset),
+          produced(checkpoint.originalOffset) {
+    if (entry.dataStart > entry.dataEnd || entry.dataEnd > reader.tableOffset) return;
+    if (entry.compressionMethod != CompressionMethod::ZLIB || position > entry.dataEnd) return;
+    if (checkpoint.window.size() != INFLATEWINDOWSIZE || (checkpoint.bits > 0 && checkpoint.compressedOffset == 0)) return;
+
+    // Checkpoints sit between deflate blocks, after the zlib header, so the rest is inflated as raw deflate data
+    inflater = std::make_unique<Inflater>(-MAX_WBITS);
+    if (!inflater->pooled.valid()) return;
+
+    // A block can end part way through a byte, the rest of that byte has to be fed in first
+    if (checkpoint.bits > 0) {
+        unsigned char partial;
+        if (!reader.readFromArchive(position - 1, reinterpret_cast<char*>(&partial), 1)) return;
+        if (inflatePrime(&inflater->strm, checkpoint.bits, partial >> (8 - checkpoint.bits)) != Z_OK) return;
+    }
 
-    if (validateCrc && calculatedCrc != entry.crc32) return 0;
+    if (inflateSetDictionary(&inflater->strm, checkpoint.window.data(), INFLATEWINDOWSIZE) != Z_OK) return;
 
-    return (uint64_t) archive.tellg() - entry.dataStart;
+    state = State::READING;
 }
 
-uint64_t
-DatArchive::DatArchiveReader::zlibExtractFile(const DatArchive::TableEntry& entry, char* buffer, bool validateCrc) {
-    archive.seekg(entry.dataStart);
+DatArchive::EntryStream::EntryStream(DatArchive::EntryStream&& other) noexcept = default;
 
-    int rc;
-    unsigned have;
-    z_stream strm;
+DatArchive::EntryStream& DatArchive::EntryStream::operator=(DatArchive::EntryStream&& other) noexcept = default;
 
-    unsigned char* in = new unsigned char[CHUNKSIZE];
+DatArchive::EntryStream::~EntryStream() = default;
 
-    uint32_t calculatedCrc = 0;
+bool DatArchive::EntryStream::refillInput() {
+    uint64_t availableBytes = std::min<uint64_t>(CHUNKSIZE, entry.dataEnd - position);
+    if (availableBytes == 0) return false;
 
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.avail_in = 0;
-    strm.next_in = Z_NULL;
-    strm.avail_out = entry.originalSize;
-    strm.next_out = reinterpret_cast<unsigned char*>(buffer);
+    if (!reader->readFromArchive(position, reinterpret_cast<char*>(inflater->input), availableBytes)) return false;
 
-    rc = inflateInit(&strm);
-    if (rc != Z_OK) return 0;
+    if (validateCrc) calculatedCrc = fastCrc32(calculatedCrc, inflater->input, availableBytes);
 
-    do {
-        uint64_t availableBytes = (uint64_t) archive.tellg() + CHUNKSIZE < entry.dataEnd
-                                  ? CHUNKSIZE
-                                  : entry.dataEnd - (uint64_t) archive.tellg();
-        archive.read(reinterpret_cast<char*>(in), availableBytes);
-        strm.avail_in = availableBytes;
-        strm.next_in = in;
+    position += availableBytes;
+    inflater->strm.next_in = inflater->input;
+    inflater->strm.avail_in = availableBytes;
 
-        if (archive.bad()) {
-            badFlag = true;
-            inflateEnd(&strm);
-            delete[] in;
-            return 0;
-        }
+    return true;
+}
 
-        calculatedCrc = crc32(calculatedCrc, in, availableBytes);
+void DatArchive::EntryStream::finish() {
+    // The CRC covers everything stored for the file, including anything after the compressed data like a block table
+    while (validateCrc && inflater != nullptr && position < entry.dataEnd) {
+        uint64_t availableBytes = std::min<uint64_t>(CHUNKSIZE, entry.dataEnd - position);
 
-        rc = inflate(&strm, Z_NO_FLUSH);
-        switch (rc) {
-            case Z_NEED_DICT:
-            case Z_DATA_ERROR:
-            case Z_MEM_ERROR:
-                badFlag = false;
-                inflateEnd(&strm);
-                delete[] in;
-                return 0;
+        if (!reader->readFromArchive(position, reinterpret_cast<char*>(inflater->input), availableBytes)) {
+            state = State::FAILED;
+            inflater.reset();
+            return;
         }
-    } while (rc != Z_STREAM_END);
 
-    inflateEnd(&strm);
+        calculatedCrc = fastCrc32(calculatedCrc, inflater->input, availableBytes);
+        position += availableBytes;
+    }
 
-    if (validateCrc && calculatedCrc != entry.crc32) return 0;
+    if (produced != entry.originalSize) state = State::FAILED;
+    else if (validateCrc && calculatedCrc != entry.crc32) state = State::CRC_MISMATCH;
+    else state = State::FINISHED;
 
-    return entry.originalSize;
+    inflater.reset();
 }
 
-DatArchive::DatArchiveReader::DatArchiveReader(const std::filesystem::path& archiveFilePath) : archivePath(archiveFilePath) {
-    openArchive(archiveFilePath);
-}
+size_t DatArchive::EntryStream::read(char* buffer, size_t size) {
+    if (state != State::READING || size == 0) return 0;
 
-bool DatArchive::DatArchiveReader::openArchive(const std::filesystem::path& archiveFilePath) {
-    openFlag = false;
-    badFlag = false;
+    if (entry.compressionMethod == CompressionMethod::NONE) {
+        size = std::min<uint64_t>(size, entry.dataEnd - position);
 
-    if (!exists(archiveFilePath) && !is_directory(archiveFilePath)) {
-        return false;
-    }
-    archive.open(archiveFilePath, std::ios::in | std::ios::binary);
+        if (!reader->readFromArchive(position, buffer, size)) {
+            state = State::FAILED;
+            return 0;
+        }
 
-    if (!archive) {
-        return false;
+        if (validateCrc) calculatedCrc = fastCrc32(calculatedCrc, reinterpret_cast<unsigned char*>(buffer), size);
+
+        position += size;
+        produced += size;
+
+        if (position == entry.dataEnd) finish();
+
+        return size;
     }
-    openFlag = true;
 
-    char signature[4];
+    z_stream& strm = inflater->strm;
+    strm.next_out = reinterpret_cast<unsigned char*>(buffer);
+    strm.avail_out = std::min<size_t>(size, UINT_MAX);
+    size = strm.avail_out;
 
-    archive.read(signature, 4);
-    archive.read(reinterpret_cast<char*>(&archiveVersion), 1);
+    while (strm.avail_out > 0) {
+        if (strm.avail_in == 0 && !refillInput()) {
+            // Either the archive couldn't be read, or the file ended before the zlib stream did
+            state = State::FAILED;
+            break;
+        }
 
-    if (!validateArchive(signature, archiveVersion)) {
-        badFlag = true;
-        return false;
+        int rc = inflate(&strm, Z_NO_FLUSH);
+
+        // Every block is its own zlib stream, so carry on into the next one until the whole file has been produced
+        if (rc == Z_STREAM_END && entry.compressionMethod == CompressionMethod::ZLIB_BLOCKS
+            && produced + (size - strm.avail_out) < entry.originalSize) {
+            rc = inflateReset(&strm);
+        }
+
+        if (rc == Z_STREAM_END) {
+            produced += size - strm.avail_out;
+            finish();
+            return size - strm.avail_out;
+        }
+        if (rc != Z_OK) {
+            state = State::FAILED;
+            break;
+        }
     }
 
-    archive.read(reinterpret_cast<char*>(&tableOffset), 8);
+    size -= strm.avail_out;
+    produced += size;
 
-    return loadTable();
+    return state == State::READING ? size : 0;
 }
 
-bool DatArchive::DatArchiveReader::closeArchive() {
-    if (openFlag) return false;
-    archive.close();
-    openFlag = false;
-    return true;
-}
+uint64_t DatArchive::EntryStream::skip(uint64_t count) {
+    if (state != State::READING || count == 0) return 0;
 
-size_t DatArchive::DatArchiveReader::size() const {
-    return entries.size();
-}
+    // The skipped bytes never pass through the CRC
+    validateCrc = false;
 
-bool DatArchive::DatArchiveReader::contains(const std::string& name) const {
-    return entries.count(name) > 0;
-}
+    if (entry.compressionMethod == CompressionMethod::NONE) {
+        count = std::min<uint64_t>(count, entry.dataEnd - position);
+        position += count;
+        produced += count;
 
-std::vector<std::string> DatArchive::DatArchiveReader::listFiles() const {
-    std::vector<std::string> keys(entries.size());
+        if (position == entry.dataEnd) finish();
 
-    // Extract keys from entries
-    std::transform(entries.begin(), entries.end(), keys.begin(), [keys](auto pair) {return pair.first;});
+        return count;
+    }
 
-    return keys;
-}
+    uint64_t skipped = 0;
+    if (entry.compressionMethod == CompressionMethod::ZLIB_BLOCKS) {
+        uint64_t start = produced;
+        seekBlock(produced + count);
+        skipped = produced - start;
+    }
 
-std::vector<char> DatArchive::DatArchiveReader::getFile(const std::string& name) {
-    if (!openFlag || badFlag) return {};
+    PooledBuffer discard;
 
-    if (!contains(name)) return {};
-    const TableEntry& entry = getFileEntry(name);
+    while (skipped < count) {
+        size_t have = read(reinterpret_cast<char*>(discard.get()), std::min<uint64_t>(CHUNKSIZE, count - skipped));
+        if (have == 0) break;
 
-    std::vector<char> dest(entry.originalSize);
+        skipped += have;
+    }
 
-    if (getFileFromEntry(entry, dest.data())) return dest;
-    else return {};
+    return skipped;
 }
 
-uint64_t DatArchive::DatArchiveReader::getFileRaw(const std::string& name, char* buffer) {
-    if (!openFlag || badFlag) return 0;
-    if (!contains(name)) return {};
-    const TableEntry& entry = getFileEntry(name);
+void DatArchive::EntryStream::seekBlock(uint64_t target) {
+    if (state != State::READING) return;
+
+    if (!inflater->blockTableRead) {
+        inflater->blockTableRead = true;
+        if (!reader->readBlockTable(entry, inflater->blockEnds, inflater->blockSize)) inflater->blockEnds.clear();
+    }
+
+    if (inflater->blockEnds.empty()) return;
+
+    // The current block has already been partly inflated, so only jump when the target is in a later one
+    uint64_t block = target / inflater->blockSize;
+    if (block <= produced / inflater->blockSize || block >= inflater->blockEnds.size()) return;
 
-    return getFileFromEntry(entry, buffer);
+    if (inflateReset(&inflater->strm) != Z_OK) {
+        state = State::FAILED;
+        return;
+    }
+
+    position = entry.dataStart + inflater->blockEnds[block - 1];
+    produced = block * inflater->blockSize;
+    inflater->strm.avail_in = 0;
 }
 
-const DatArchive::TableEntry& DatArchive::DatArchiveReader::getFileEntry(const std::string& name) const {
-    if (!openFlag || badFlag) return {};
-    return entries.at(name);
+DatArchive::EntryStream::State DatArchive::EntryStream::getState() const {
+    return state;
 }
 
-std::vector<DatArchive::TableEntry> DatArchive::DatArchiveReader::getTable() const {
-    std::vector<TableEntry> table(entries.size());
+bool DatArchive::EntryStream::good() const {
+    return state == State::READING || state == State::FINISHED;
+}
 
-    // Extract keys from entries
-    std::transform(entries.begin(), entries.end(), table.begin(), [table](auto pair) {return pair.second;});
+uint64_t DatArchive::EntryStream::size() const {
+    return entry.originalSize;
+}
 
-    return table;
+uint64_t DatArchive::EntryStream::tell() const {
+    return produced;
 }
 
-uint64_t DatArchive::DatArchiveReader::getTableOffset() const {
-    return tableOffset;
+/*
+ * EntryStreambuf
+ */
+
+DatArchive::EntryStreambuf::EntryStreambuf(DatArchive::EntryStream entryStream) : entryStream(std::move(entryStream)),
+                                                                                  buffer(new char[CHUNKSIZE]) {
+    setg(buffer.get(), buffer.get(), buffer.get());
 }
 
-bool DatArchive::DatArchiveReader::isOpen() const {
-    return openFlag;
+DatArchive::EntryStreambuf::int_type DatArchive::EntryStreambuf::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    size_t have = entryStream.read(buffer.get(), CHUNKSIZE);
+    if (have == 0) return traits_type::eof();
+
+    setg(buffer.get(), buffer.get(), buffer.get() + have);
+
+    return traits_type::to_int_type(*gptr());
 }
 
-bool DatArchive::DatArchiveReader::isBad() const {
-    return badFlag;
+const DatArchive::EntryStream& DatArchive::EntryStreambuf::stream() const {
+    return entryStream;
 }
 
 /*
  * Writer
  */
 
+DatArchive::DatArchiveWriter::DatArchiveWriter(DatArchive::WriterOptions options) : options(options) {}
+
 void DatArchive::DatArchiveWriter::writeHeader(std::fstream& archiveFile) {
     archiveFile.write(DATFILESIGNATURE, 4);
     archiveFile.write(reinterpret_cast<const char*>(&DATFILEVERSION), 1);
@@ -283,36 +2622,121 @@ void DatArchive::DatArchiveWriter::writeHeader(std::fstream& archiveFile) {
 }
 
 void DatArchive::DatArchiveWriter::writeFiles(std::fstream& archiveFile) {
+    if (options.threadCount != 1) {
+        parallelWriteFiles(archiveFile);
+        return;
+    }
+
     for (auto& [path, entry]: fileEntries) {
-        // Open file
-        std::fstream theFile(path, std::ios::binary | std::ios::in | std::ios::ate);
+        uint64_t dataStart = archiveFile.tellp();
 
-        if (theFile.fail()) {
+        if (!compressFile(path, archiveFile, entry, nullptr)) {
             std::cout << "Failed to open \"" << path << "\", It has not been written to the archive file." << std::endl;
             continue;
         }
 
-        entry.dataStart = archiveFile.tellp();
-        entry.originalSize = theFile.tellg();
-        theFile.seekg(0);
+        entry.dataStart = dataStart;
+        entry.dataEnd = archiveFile.tellp();
+    }
+
+    archiveFile.flush();
+}
+
+void DatArchive::DatArchiveWriter::parallelWriteFiles(std::fstream& archiveFile) {
+    /**
+     * A file compressed into memory by one of the threads
+     */
+    struct CompressedFile {
+        bool opened;
+        TableEntry entry;
+        std::string data;
+    };
 
-        switch (entry.compressionMethod) {
-            case CompressionMethod::NONE:
-                writeFileToArchive(theFile, archiveFile, entry);
-                break;
-            case CompressionMethod::ZLIB:
-                zlibCompressFileToArchive(theFile, archiveFile, entry);
-                break;
+    ThreadPool pool(options.threadCount);
+
+    std::vector<std::pair<const std::filesystem::path*, TableEntry*>> files;
+    files.reserve(fileEntries.size());
+    for (auto& [path, entry]: fileEntries) files.emplace_back(&path, &entry);
+
+    // Only a few files are compressed ahead of the one being written, so they don't all end up in memory at once
+    size_t lookAhead = pool.size() * 2;
+    std::vector<std::future<CompressedFile>> compressed(files.size());
+    size_t submitted = 0;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (; submitted < files.size() && submitted <= i + lookAhead; ++submitted) {
+            const std::filesystem::path& path = *files[submitted].first;
+
+            // Large files are left invalid, to be compressed straight into the archive
+            std::error_code error;
+            uint64_t size = file_size(path, error);
+            if (!error && size > PARALLELWRITEBUFFERLIMIT) continue;
+
+            compressed[submitted] = pool.submit([this, &path, entry = *files[submitted].second]() mutable {
+                // Already on one of the pool's threads, so any chunks are deflated here rather than on the pool
+                std::ostringstream stream(std::ios::binary);
+                bool opened = compressFile(path, stream, entry, nullptr);
+
+                return CompressedFile{opened, std::move(entry), std::move(stream).str()};
+            });
+        }
+
+        const std::filesystem::path& path = *files[i].first;
+        TableEntry& entry = *files[i].second;
+        uint64_t dataStart = archiveFile.tellp();
+
+        if (compressed[i].valid()) {
+            CompressedFile file = compressed[i].get();
+
+            if (!file.opened) {
+                std::cout << "Failed to open \"" << path << "\", It has not been written to the archive file." << std::endl;
+                continue;
+            }
+
+            entry.originalSize = file.entry.originalSize;
+            entry.crc32 = file.entry.crc32;
+            archiveFile.write(file.data.data(), (std::streamsize) file.data.size());
+        } else if (!compressFile(path, archiveFile, entry, &pool)) {
+            std::cout << "Failed to open \"" << path << "\", It has not been written to the archive file." << std::endl;
+            continue;
         }
-        theFile.close();
 
+        entry.dataStart = dataStart;
         entry.dataEnd = archiveFile.tellp();
     }
 
     archiveFile.flush();
 }
 
-void DatArchive::DatArchiveWriter::writeFileToArchive(std::fstream& file, std::fstream& archiveFile,
+bool DatArchive::DatArchiveWriter::compressFile(const std::filesystem::path& path, std::ostream& stream,
+                                                DatArchive::TableEntry& entry, ThreadPool* pool) const {
+    // Open file
+    std::fstream theFile(path, std::ios::binary | std::ios::in | std::ios::ate);
+    if (theFile.fail()) return false;
+
+    entry.originalSize = theFile.tellg();
+    theFile.seekg(0);
+
+    switch (entry.compressionMethod) {
+        case CompressionMethod::NONE:
+            writeFileToArchive(theFile, stream, entry);
+            break;
+        case CompressionMethod::ZLIB:
+            if (options.chunkedDeflate && entry.originalSize > DEFLATECHUNKSIZE) {
+                chunkedZlibCompressFileToArchive(theFile, stream, entry, pool);
+            } else {
+                zlibCompressFileToArchive(theFile, stream, entry);
+            }
+            break;
+        case CompressionMethod::ZLIB_BLOCKS:
+            zlibBlocksCompressFileToArchive(theFile, stream, entry);
+            break;
+    }
+
+    return true;
+}
+
+void DatArchive::DatArchiveWriter::writeFileToArchive(std::fstream& file, std::ostream& archiveFile,
                                                       DatArchive::TableEntry& entry) {
     // Amount left
     unsigned have;
@@ -332,14 +2756,14 @@ void DatArchive::DatArchiveWriter::writeFileToArchive(std::fstream& file, std::f
         have = file.gcount();
 
         // Generate CRC
-        entry.crc32 = crc32(entry.crc32, buffer, have);
+        entry.crc32 = fastCrc32(entry.crc32, buffer, have);
 
         // Write to file
         archiveFile.write(reinterpret_cast<char*>(buffer), have);
     }
 }
 
-int DatArchive::DatArchiveWriter::zlibCompressFileToArchive(std::fstream& file, std::fstream& archiveFile,
+int DatArchive::DatArchiveWriter::zlibCompressFileToArchive(std::fstream& file, std::ostream& archiveFile,
                                                             DatArchive::TableEntry& entry) {
     int ret, flush;
     unsigned have;
@@ -391,7 +2815,7 @@ int DatArchive::DatArchiveWriter::zlibCompressFileToArchive(std::fstream& file,
             }
 
             have = CHUNKSIZE - strm.avail_out;
-            entry.crc32 = crc32(entry.crc32, out, have);
+            entry.crc32 = fastCrc32(entry.crc32, out, have);
 
             uint32_t diff = archiveFile.tellp();
             archiveFile.write(reinterpret_cast<char*>(out), have);
@@ -418,54 +2842,289 @@ int DatArchive::DatArchiveWriter::zlibCompressFileToArchive(std::fstream& file,
     return Z_OK;
 }
 
+int DatArchive::DatArchiveWriter::zlibBlocksCompressFileToArchive(std::fstream& file, std::ostream& archiveFile,
+                                                                  DatArchive::TableEntry& entry) {
+    int ret;
+    z_stream strm;
+
+    /* allocate deflate state */
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+
+    ret = deflateInit(&strm, Z_DEFAULT_COMPRESSION);
+    if (ret != Z_OK) return ret;
+
+    // A whole block is compressed at once, so the output buffer is made big enough for the worst case
+    uLong outSize = deflateBound(&strm, ZLIBBLOCKSIZE);
+    std::unique_ptr<unsigned char[]> in(new unsigned char[ZLIBBLOCKSIZE]);
+    std::unique_ptr<unsigned char[]> out(new unsigned char[outSize]);
+
+    entry.crc32 = crc32(0L, Z_NULL, 0);
+
+    std::vector<uint64_t> blockEnds;
+    uint64_t written = 0;
+
+    while (!file.eof()) {
+        file.read(reinterpret_cast<char*>(in.get()), ZLIBBLOCKSIZE);
+        uint64_t have = file.gcount();
+
+        // If there was a failure reading the file, cleanup and exit early
+        if (file.bad()) {
+            std::cerr << "Failed to read from input file during compression" << std::endl;
+            deflateEnd(&strm);
+
+            return Z_ERRNO;
+        }
+
+        if (have == 0) break;
+
+        // Each block is a complete zlib stream of its own, so it can be inflated without any of the others
+        deflateReset(&strm);
+        strm.next_in = in.get();
+        strm.avail_in = have;
+        strm.next_out = out.get();
+        strm.avail_out = outSize;
+
+        ret = deflate(&strm, Z_FINISH);
+        if (ret != Z_STREAM_END) {
+            std::cerr << "Compression resulted in bad state" << std::endl;
+            deflateEnd(&strm);
+
+            return ret == Z_OK ? Z_BUF_ERROR : ret;
+        }
+
+        uint64_t compressedSize = outSize - strm.avail_out;
+        entry.crc32 = fastCrc32(entry.crc32, out.get(), compressedSize);
+        archiveFile.write(reinterpret_cast<char*>(out.get()), (std::streamsize) compressedSize);
+
+        if (archiveFile.fail()) {
+            std::cerr << "Failed to write to archive file during compression" << std::endl;
+            deflateEnd(&strm);
+
+            return Z_ERRNO;
+        }
+
+        written += compressedSize;
+        blockEnds.push_back(written);
+    }
+
+    deflateEnd(&strm);
+
+    // Finish with the block table, so a reader can find any block without inflating the ones before it
+    BlockTableFooter footer{ZLIBBLOCKSIZE, (uint32_t) blockEnds.size()};
+
+    entry.crc32 = fastCrc32(entry.crc32, reinterpret_cast<const unsigned char*>(blockEnds.data()),
+                            blockEnds.size() * sizeof(uint64_t));
+    entry.crc32 = fastCrc32(entry.crc32, reinterpret_cast<const unsigned char*>(&footer), sizeof(footer));
+
+    archiveFile.write(reinterpret_cast<const char*>(blockEnds.data()),
+                      (std::streamsize) (blockEnds.size() * sizeof(uint64_t)));
+    archiveFile.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+    if (archiveFile.fail()) {
+        std::cerr << "Failed to write to archive file during compression" << std::endl;
+        return Z_ERRNO;
+    }
+
+    return Z_OK;
+}
+
+int DatArchive::DatArchiveWriter::chunkedZlibCompressFileToArchive(std::fstream& file, std::ostream& archiveFile,
+                                                                   DatArchive::TableEntry& entry, ThreadPool* pool) {
+    /**
+     * A chunk of the file deflated into memory
+     */
+    struct DeflatedChunk {
+        int ret;
+        std::string data;
+        uint64_t originalSize;
+        uLong adler;
+        uLong crc;
+    };
+
+    // Deflate a chunk as raw deflate data, so the chunks can be joined into a single stream
+    auto deflateChunk = [](std::shared_ptr<const std::vector<unsigned char>> input,
+                           std::shared_ptr<const std::vector<unsigned char>> previous, bool last) {
+        DeflatedChunk chunk{Z_OK, {}, input->size(), adler32_z(1L, input->data(), input->size()), 0};
+
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+
+        chunk.ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        if (chunk.ret != Z_OK) return chunk;
+
+        // Let the chunk refer back into the end of the one before it, as it would in a serial stream
+        if (previous != nullptr) {
+            uInt dictionarySize = std::min<size_t>(previous->size(), INFLATEWINDOWSIZE);
+            deflateSetDictionary(&strm, previous->data() + previous->size() - dictionarySize, dictionarySize);
+        }
+
+        // A sync flush ends the chunk on a byte boundary without ending the stream, so the next chunk can follow it
+        int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+        chunk.data.resize(deflateBound(&strm, input->size()) + 16);
+        strm.next_in = const_cast<unsigned char*>(input->data());
+        strm.avail_in = input->size();
+        strm.next_out = reinterpret_cast<unsigned char*>(chunk.data.data());
+        strm.avail_out = chunk.data.size();
+
+        while (true) {
+            chunk.ret = deflate(&strm, flush);
+            if (chunk.ret != Z_OK || strm.avail_out != 0) break;
+
+            // Out of space, which deflateBound should prevent, but grow the buffer just in case
+            size_t used = chunk.data.size();
+            chunk.data.resize(used * 2);
+            strm.next_out = reinterpret_cast<unsigned char*>(chunk.data.data()) + used;
+            strm.avail_out = chunk.data.size() - used;
+        }
+
+        chunk.data.resize(chunk.data.size() - strm.avail_out);
+        // A sync flush with nothing left to flush reports Z_BUF_ERROR, which isn't a failure here
+        bool finished = last ? chunk.ret == Z_STREAM_END : chunk.ret == Z_OK || chunk.ret == Z_BUF_ERROR;
+        chunk.ret = finished ? Z_OK : Z_STREAM_ERROR;
+        chunk.crc = fastCrc32(0, reinterpret_cast<const unsigned char*>(chunk.data.data()), chunk.data.size());
+
+        deflateEnd(&strm);
+
+        return chunk;
+    };
+
+    // The same header deflateInit writes for Z_DEFAULT_COMPRESSION
+    const unsigned char header[2] = {0x78, 0x9C};
+    entry.crc32 = fastCrc32(0, header, sizeof(header));
+    archiveFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    int ret = Z_OK;
+
+    auto writeChunk = [&](const DeflatedChunk& chunk) {
+        if (ret != Z_OK) return;
+        if (chunk.ret != Z_OK) {
+            std::cerr << "Compression resulted in bad state" << std::endl;
+            ret = chunk.ret;
+            return;
+        }
+
+        archiveFile.write(chunk.data.data(), (std::streamsize) chunk.data.size());
+        if (archiveFile.fail()) {
+            std::cerr << "Failed to write to archive file during compression" << std::endl;
+            ret = Z_ERRNO;
+            return;
+        }
+
+        entry.crc32 = crc32_combine(entry.crc32, chunk.crc, (z_off_t) chunk.data.size());
+        adler = adler32_combine(adler, chunk.adler, (z_off_t) chunk.originalSize);
+    };
+
+    // Only a few chunks are deflated ahead of the one being written, so the whole file doesn't end up in memory
+    std::deque<std::future<DeflatedChunk>> pending;
+    size_t lookAhead = pool != nullptr ? pool->size() * 2 : 0;
+
+    std::shared_ptr<const std::vector<unsigned char>> previous;
+    uint64_t remaining = entry.originalSize;
+
+    while (remaining > 0 && ret == Z_OK) {
+        auto input = std::make_shared<std::vector<unsigned char>>(std::min(remaining, DEFLATECHUNKSIZE));
+        file.read(reinterpret_cast<char*>(input->data()), (std::streamsize) input->size());
+
+        // If there was a failure reading the file, stop early
+        if ((uint64_t) file.gcount() != input->size()) {
+            std::cerr << "Failed to read from input file during compression" << std::endl;
+            ret = Z_ERRNO;
+            break;
+        }
+
+        remaining -= input->size();
+
+        if (pool == nullptr) {
+            writeChunk(deflateChunk(input, previous, remaining == 0));
+        } else {
+            pending.push_back(pool->submit([deflateChunk, input, previous, last = remaining == 0]() {
+                return deflateChunk(input, previous, last);
+            }));
+
+            if (pending.size() > lookAhead) {
+                writeChunk(pending.front().get());
+                pending.pop_front();
+            }
+        }
+
+        previous = std::move(input);
+    }
+
+    for (; !pending.empty(); pending.pop_front()) writeChunk(pending.front().get());
+
+    if (ret != Z_OK) return ret;
+
+    // Finish with the Adler-32 checksum of the original file, as a serial stream would
+    const unsigned char trailer[4] = {(unsigned char) (adler >> 24), (unsigned char) (adler >> 16),
+                                      (unsigned char) (adler >> 8), (unsigned char) adler};
+    entry.crc32 = fastCrc32(entry.crc32, trailer, sizeof(trailer));
+    archiveFile.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+
+    if (archiveFile.fail()) {
+        std::cerr << "Failed to write to archive file during compression" << std::endl;
+        return Z_ERRNO;
+    }
+
+    return Z_OK;
+}
+
 void DatArchive::DatArchiveWriter::writeTableLocation(std::fstream& archiveFile) {
+    // Align the table so a reader can use the mapped records in place
     uint64_t tableOffset = archiveFile.tellp();
-    // Write table offset
-    archiveFile.seekp(5);
+    uint64_t padding = (alignof(EntryRecord) - tableOffset % alignof(EntryRecord)) % alignof(EntryRecord);
+
+    char empty[alignof(EntryRecord)] = {};
+    archiveFile.write(empty, (std::streamsize) padding);
+    tableOffset += padding;
+
+    // Write version and table offset
+    archiveFile.seekp(4);
+    archiveFile.write(reinterpret_cast<const char*>(&DATFILEVERSION), 1);
     archiveFile.write(reinterpret_cast<char*>(&tableOffset), 8);
-    archiveFile.seekp(tableOffset);
+    archiveFile.seekp((std::streamoff) tableOffset);
 }
 
 void DatArchive::DatArchiveWriter::writeTable(std::fstream& archiveFile) {
-    for (const auto& [path, entry]: fileEntries) {
-        writeTableEntry(archiveFile, entry);
-    }
-
-    archiveFile.flush();
-}
+    std::vector<TableEntry> entries;
+    entries.reserve(fileEntries.size());
 
-void DatArchive::DatArchiveWriter::writeTable(std::fstream& archiveFile, const std::vector<TableEntry>& entries) {
-    for (const auto& entry: entries) {
-        writeTableEntry(archiveFile, entry);
+    for (const auto& [path, entry]: fileEntries) {
+        entries.push_back(entry);
     }
 
-    archiveFile.flush();
+    writeTable(archiveFile, std::move(entries));
 }
 
-void DatArchive::DatArchiveWriter::writeTableEntry(std::fstream& archiveFile, const DatArchive::TableEntry& entry) {
-    // Name
-    uint16_t nameSize = entry.name.size();
-    archiveFile.write(reinterpret_cast<char*>(&nameSize), 2);
-    archiveFile.write(entry.name.data(), nameSize);
+void DatArchive::DatArchiveWriter::writeTable(std::fstream& archiveFile, std::vector<TableEntry> entries) {
+    // Sorting by name lets readers binary search the table without building an index
+    std::sort(entries.begin(), entries.end(), [](const TableEntry& a, const TableEntry& b) {return a.name < b.name;});
 
-    // Compression method
-    archiveFile.write(reinterpret_cast<const char*>(&entry.compressionMethod), 1);
+    std::vector<EntryRecord> records;
+    records.reserve(entries.size());
+    std::string nameHeap;
 
-    // flags
-    uint8_t flagBuffer = (uint8_t) entry.fileFlags;
-    archiveFile.write(reinterpret_cast<char*>(&flagBuffer), 1);
+    for (const TableEntry& entry: entries) appendRecord(records, nameHeap, entry);
 
-    // crc32
-    archiveFile.write(reinterpret_cast<const char*>(&entry.crc32), 4);
+    writeTable(archiveFile, records, nameHeap);
+}
 
-    // Original Size
-    archiveFile.write(reinterpret_cast<const char*>(&entry.originalSize), 8);
+void DatArchive::DatArchiveWriter::writeTable(std::fstream& archiveFile, const std::vector<EntryRecord>& records,
+                                              const std::string& nameHeap) {
+    uint64_t entryCount = records.size();
+    uint64_t nameHeapSize = nameHeap.size();
 
-    // dataStart
-    archiveFile.write(reinterpret_cast<const char*>(&entry.dataStart), 8);
+    archiveFile.write(reinterpret_cast<const char*>(&entryCount), 8);
+    archiveFile.write(reinterpret_cast<const char*>(&nameHeapSize), 8);
+    archiveFile.write(reinterpret_cast<const char*>(records.data()),
+                      (std::streamsize) (records.size() * sizeof(EntryRecord)));
+    archiveFile.write(nameHeap.data(), (std::streamsize) nameHeap.size());
 
-    // dataEnd
-    archiveFile.write(reinterpret_cast<const char*>(&entry.dataEnd), 8);
+    archiveFile.flush();
 }
 
 bool DatArchive::DatArchiveWriter::queueFile(const std::filesystem::path& path, DatArchive::TableEntry entry) {
@@ -529,33 +3188,61 @@ bool DatArchive::DatArchiveWriter::appendArchive(const std::filesystem::path& de
     }
 
     uint64_t tableOffset = archive.getTableOffset();
-    std::vector<TableEntry> entries = archive.getTable();
-    archive.closeArchive();
-
-    // Sort the entries to maintain their order
-    std::sort(entries.begin(), entries.end(), [](const TableEntry& a, const TableEntry& b) {return a.dataStart < b.dataStart;});
 
     // Filter queued files to skip any that are already in the archive
     auto it = fileEntries.begin();
     while (it != fileEntries.end()) {
-        if (std::count_if(entries.begin(), entries.end(), [&it](const TableEntry& entry){return entry.name == it->second.name;})) {
+        if (archive.contains(it->second.name)) {
             std::cout << "A file with the name \"" << it->second.name << "\" already exists in the archive, it will be skipped";
             fileEntries.erase(it++);
         } else ++it;
     }
 
+    // The old table is about to be written over, so it is copied out first as compactly as possible, in name order
+    std::vector<EntryRecord> records;
+    std::string nameHeap;
+    records.reserve(archive.size() + fileEntries.size());
+    for (EntryView entry: archive.entriesByName()) {
+        EntryRecord& record = records.emplace_back(entry.record());
+        record.nameOffset = nameHeap.size();
+        nameHeap.append(entry.name());
+    }
+    archive.closeArchive();
+
     std::fstream stream(destinationArchive, std::ios::binary | std::ios::in | std::ios::out);
-    stream.seekp(tableOffset);
+    stream.seekp((std::streamoff) tableOffset);
 
     writeFiles(stream);
     writeTableLocation(stream);
 
-    // Write old table then new table
-    writeTable(stream, entries);
-    writeTable(stream);
+    // Write the old and new entries as one table, merging the new ones in among the old ones that are already sorted
+    size_t oldCount = records.size();
+    for (const auto& [path, entry]: fileEntries) appendRecord(records, nameHeap, entry);
+
+    auto byName = [&nameHeap](const EntryRecord& a, const EntryRecord& b) {
+        return a.name(nameHeap) < b.name(nameHeap);
+    };
+    std::sort(records.begin() + (std::ptrdiff_t) oldCount, records.end(), byName);
+    std::inplace_merge(records.begin(), records.begin() + (std::ptrdiff_t) oldCount, records.end(), byName);
+
+    // Lay the names out in the same order as the records, as they would be in a table written in one go
+    std::string sortedNameHeap;
+    sortedNameHeap.reserve(nameHeap.size());
+    for (EntryRecord& record: records) {
+        std::string_view name = record.name(nameHeap);
+        record.nameOffset = sortedNameHeap.size();
+        sortedNameHeap.append(name);
+    }
+
+    writeTable(stream, records, sortedNameHeap);
+
+    uint64_t archiveEnd = stream.tellp();
 
     stream.flush();
     stream.close();
 
+    // Drop anything left over from the old table
+    resize_file(destinationArchive, archiveEnd);
+
     return true;
 }
@@ -0,0 +1,85 @@
+#include "entry-cache.h"
+
+DatArchive::EntryCache::Key::Key(const DatArchive::EntryRecord& entry)
+        : dataStart(entry.dataStart), dataEnd(entry.dataEnd), originalSize(entry.originalSize), crc32(entry.crc32),
+          compressionMethod(entry.compressionMethod) {}
+
+size_t DatArchive::EntryCache::KeyHash::operator()(const DatArchive::EntryCache::Key& key) const {
+    // Data offsets share their low bits far too often to be used directly, so they are mixed first
+    uint64_t hash = key.dataStart * 0x9E3779B97F4A7C15ull;
+    hash ^= (key.dataEnd + key.originalSize + key.crc32) * 0xC2B2AE3D27D4EB4Full;
+    return hash >> 32 ^ hash;
+}
+
+DatArchive::EntryCache::EntryCache(uint64_t capacity) : shardCapacity(capacity / ENTRYCACHESHARDCOUNT) {}
+
+DatArchive::EntryCache::Shard& DatArchive::EntryCache::shardFor(const Key& key) {
+    // Only the start of the data picks the shard, entries sharing it differ too rarely to be worth spreading
+    return shards[(key.dataStart * 0x9E3779B97F4A7C15ull >> 32) % ENTRYCACHESHARDCOUNT];
+}
+
+std::shared_ptr<const std::vector<char>> DatArchive::EntryCache::find(const DatArchive::EntryRecord& entry) {
+    Key key(entry);
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.positions.find(key);
+    if (found == shard.positions.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    shard.files.splice(shard.files.begin(), shard.files, found->second);
+    hits.fetch_add(1, std::memory_order_relaxed);
+
+    return found->second->second;
+}
+
+void DatArchive::EntryCache::insert(const DatArchive::EntryRecord& entry,
+                                    std::shared_ptr<const std::vector<char>> file) {
+    if (file->size() != entry.originalSize || !fits(file->size())) return;
+
+    Key key(entry);
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have extracted the same file at the same time
+    if (shard.positions.contains(key)) return;
+
+    while (!shard.files.empty() && shard.size + file->size() > shardCapacity) {
+        shard.size -= shard.files.back().second->size();
+        shard.positions.erase(shard.files.back().first);
+        shard.files.pop_back();
+
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.size += file->size();
+    shard.files.emplace_front(key, std::move(file));
+    shard.positions.emplace(key, shard.files.begin());
+}
+
+bool DatArchive::EntryCache::fits(uint64_t size) const {
+    return size > 0 && size <= shardCapacity;
+}
+
+DatArchive::CacheStats DatArchive::EntryCache::getStats() {
+    CacheStats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.evictions = evictions.load(std::memory_order_relaxed);
+
+    for (Shard& shard: shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.files += shard.files.size();
+        stats.size += shard.size;
+    }
+
+    return stats;
+}
+
+void DatArchive::EntryCache::resetStats() {
+    hits.store(0, std::memory_order_relaxed);
+    misses.store(0, std::memory_order_relaxed);
+    evictions.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/dat-archive.h"
+
+namespace DatArchive {
+    /** The number of separately locked parts an EntryCache is split into, so threads rarely wait on each other */
+    constexpr size_t ENTRYCACHESHARDCOUNT = 16;
+
+    /**
+     * A thread-safe cache of extracted files that drops the least recently used files once it is over its size
+     * <br>
+     * Files are keyed by the whole of their entry's data range, size, checksum and compression method, so entries
+     * that share data but disagree about what it holds never see each other's files. The cache is split into
+     * ENTRYCACHESHARDCOUNT shards, each with an equal share of the capacity and its own lock. Files larger than a
+     * shard's share are never cached.
+     */
+    class EntryCache {
+        /**
+         * The parts of an entry that decide what extracting it gives
+         */
+        struct Key {
+            uint64_t dataStart;
+            uint64_t dataEnd;
+            uint64_t originalSize;
+            uint32_t crc32;
+            CompressionMethod compressionMethod;
+
+            explicit Key(const EntryRecord& entry);
+
+            bool operator==(const Key& other) const = default;
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        /**
+         * A part of the cache, with its own lock and share of the capacity
+         */
+        struct Shard {
+            std::mutex mutex;
+            /** The files held, the most recently used first */
+            std::list<std::pair<Key, std::shared_ptr<const std::vector<char>>>> files;
+            /** Where each file is in the list */
+            std::unordered_map<Key, decltype(files)::iterator, KeyHash> positions;
+            /** The total size of the files held */
+            uint64_t size = 0;
+        };
+
+        std::array<Shard, ENTRYCACHESHARDCOUNT> shards;
+        uint64_t shardCapacity;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+
+        /**
+         * Get the shard a file belongs in
+         * @param key The file's key
+         * @return The shard
+         */
+        Shard& shardFor(const Key& key);
+
+    public:
+        /**
+         * @param capacity The most bytes of files to hold
+         */
+        explicit EntryCache(uint64_t capacity);
+
+        /**
+         * Look for a file, marking it as the most recently used if it is found
+         * @param entry The file's entry
+         * @return The file, nullptr if it isn't cached
+         */
+        std::shared_ptr<const std::vector<char>> find(const EntryRecord& entry);
+
+        /**
+         * Add a file, dropping the least recently used files in its shard to make room
+         * <br>
+         * If the file is already cached, the cached copy is kept. Files that aren't the size their entry gives are never
+         * cached.
+         * @param entry The file's entry
+         * @param file The file
+         */
+        void insert(const EntryRecord& entry, std::shared_ptr<const std::vector<char>> file);
+
+        /**
+         * Check whether a file is small enough to be cached
+         * @param size The size of the file
+         * @return true if insert() would keep the file
+         */
+        [[nodiscard]] bool fits(uint64_t size) const;
+
+        /**
+         * Get the counts of hits, misses and evictions, and how much is cached
+         * @return The counts since the cache was created or resetStats() was last called
+         */
+        [[nodiscard]] CacheStats getStats();
+
+        /**
+         * Set the hit, miss and eviction counts back to 0
+         */
+        void resetStats();
+    };
+}
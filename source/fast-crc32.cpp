@@ -0,0 +1,209 @@
+#include "fast-crc32.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <cstring>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace {
+    using Crc32Function = uint32_t (*)(uint32_t crc, const unsigned char* data, uint64_t size);
+
+    uint32_t zlibCrc32(uint32_t crc, const unsigned char* data, uint64_t size) {
+        return crc32_z(crc, data, size);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    /**
+     * Fold 16 byte blocks of data into a CRC using carry-less multiplication, as described in Intel's "Fast CRC
+     * Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+     * @param state The CRC so far, inverted as zlib keeps it while working
+     * @param data The data, at least 64 bytes
+     * @param size The size of the data, a multiple of 16
+     * @return The updated CRC, still inverted
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    uint32_t pclmulFold(uint32_t state, const unsigned char* data, uint64_t size) {
+        // Powers of x modulo the bit reflected polynomial, and the polynomial and its quotient for Barrett reduction
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) state));
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+        data += 64;
+        size -= 64;
+
+        // Fold four blocks at a time, so the multiplications don't wait on each other
+        while (size >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+            y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+            y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+            y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+            data += 64;
+            size -= 64;
+        }
+
+        // Fold the four blocks into one
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+        for (__m128i next: {x2, x3, x4}) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+        }
+
+        // Fold in any blocks left over
+        while (size >= 16) {
+            x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+            data += 16;
+            size -= 16;
+        }
+
+        // Fold 128 bits down to 64
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduce to 32 bits
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (uint32_t) _mm_extract_epi32(x1, 1);
+    }
+
+    uint32_t pclmulCrc32(uint32_t crc, const unsigned char* data, uint64_t size) {
+        if (size < 64) return crc32_z(crc, data, size);
+
+        // Fold as much as possible, leaving zlib to finish the last few bytes
+        uint64_t folded = size & ~(uint64_t) 15;
+        crc = ~pclmulFold(~crc, data, folded);
+
+        return crc32_z(crc, data + folded, size - folded);
+    }
+
+    Crc32Function selectCrc32() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) return pclmulCrc32;
+
+        return zlibCrc32;
+    }
+#elif defined(__aarch64__)
+#if defined(__clang__)
+    __attribute__((target("crc")))
+#else
+    __attribute__((target("+crc")))
+#endif
+    uint32_t armCrc32(uint32_t crc, const unsigned char* data, uint64_t size) {
+        uint32_t state = ~crc;
+
+        // Work up to an aligned word, then take the data a word at a time
+        while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+            state = __crc32b(state, *data++);
+            --size;
+        }
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            state = __crc32d(state, word);
+        }
+        for (; size > 0; --size) state = __crc32b(state, *data++);
+
+        return ~state;
+    }
+
+    Crc32Function selectCrc32() {
+#if defined(__APPLE__)
+        // Every ARM processor Apple has shipped has the CRC32 instructions
+        return armCrc32;
+#elif defined(__linux__)
+        if ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0) return armCrc32;
+        return zlibCrc32;
+#else
+        return zlibCrc32;
+#endif
+    }
+#else
+    Crc32Function selectCrc32() {
+        return zlibCrc32;
+    }
+#endif
+}
+
+uint32_t DatArchive::fastCrc32(uint32_t crc, const unsigned char* data, uint64_t size) {
+    static const Crc32Function implementation = selectCrc32();
+
+    return implementation(crc, data, size);
+}
+
+uint32_t DatArchive::parallelCrc32(uint32_t crc, const unsigned char* data, uint64_t size, ThreadPool& pool) {
+    if (size <= PARALLELCRCSLICESIZE) return fastCrc32(crc, data, size);
+
+    std::vector<std::future<uint32_t>> sliceCrcs;
+    sliceCrcs.reserve((size - 1) / PARALLELCRCSLICESIZE + 1);
+
+    for (uint64_t start = 0; start < size; start += PARALLELCRCSLICESIZE) {
+        uint64_t length = std::min(PARALLELCRCSLICESIZE, size - start);
+        sliceCrcs.push_back(pool.submit([data, start, length]() { return fastCrc32(0, data + start, length); }));
+    }
+
+    for (uint64_t slice = 0; slice < sliceCrcs.size(); ++slice) {
+        uint64_t length = std::min(PARALLELCRCSLICESIZE, size - slice * PARALLELCRCSLICESIZE);
+        crc = crc32_combine(crc, sliceCrcs[slice].get(), (z_off_t) length);
+    }
+
+    return crc;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+#include "thread-pool.h"
+
+namespace DatArchive {
+    /** The amount of data each task checksums in a parallelCrc32 */
+    constexpr uint64_t PARALLELCRCSLICESIZE = 4194304;
+
+    /**
+     * Update a CRC32 checksum, giving the same result as zlib's crc32_z
+     * <br>
+     * This uses carry-less multiplication on x86 processors with PCLMULQDQ, or the CRC32 instructions on ARMv8
+     * processors that have them, and falls back to zlib otherwise. The choice is made once, the first time this is
+     * called.
+     * @param crc The checksum of the data before this, 0 to start a new checksum
+     * @param data The data to add to the checksum
+     * @param size The size of the data in bytes
+     * @return The updated checksum
+     */
+    uint32_t fastCrc32(uint32_t crc, const unsigned char* data, uint64_t size);
+
+    /**
+     * Update a CRC32 checksum using every thread of a pool
+     * <br>
+     * The data is split into PARALLELCRCSLICESIZE slices, which are checksummed separately and joined with
+     * crc32_combine. This must not be called from one of the pool's threads.
+     * @param crc The checksum of the data before this, 0 to start a new checksum
+     * @param data The data to add to the checksum
+     * @param size The size of the data in bytes
+     * @param pool The threads to checksum on
+     * @return The updated checksum
+     */
+    uint32_t parallelCrc32(uint32_t crc, const unsigned char* data, uint64_t size, ThreadPool& pool);
+}
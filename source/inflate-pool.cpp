@@ -0,0 +1,135 @@
+#include "inflate-pool.h"
+
+#include <atomic>
+#include <vector>
+
+namespace {
+    std::atomic<uint64_t> inflaterHits{0};
+    std::atomic<uint64_t> inflaterMisses{0};
+    std::atomic<uint64_t> bufferHits{0};
+    std::atomic<uint64_t> bufferMisses{0};
+
+    /**
+     * The inflate states and buffers kept by a thread, released when the thread exits
+     */
+    struct ThreadCache {
+        std::vector<z_stream*> inflaters;
+        std::vector<unsigned char*> buffers;
+
+        ThreadCache() {
+            inflaters.reserve(DatArchive::POOLEDPERTHREAD);
+            buffers.reserve(DatArchive::POOLEDPERTHREAD);
+        }
+
+        ~ThreadCache() {
+            for (z_stream* strm: inflaters) {
+                inflateEnd(strm);
+                delete strm;
+            }
+            for (unsigned char* buffer: buffers) delete[] buffer;
+        }
+    };
+
+    thread_local ThreadCache threadCache;
+}
+
+/*
+ * PooledInflater
+ */
+
+DatArchive::PooledInflater::PooledInflater(int windowBits) {
+    if (!threadCache.inflaters.empty()) {
+        strm = threadCache.inflaters.back();
+        threadCache.inflaters.pop_back();
+        inflaterHits.fetch_add(1, std::memory_order_relaxed);
+
+        // Resetting keeps the allocated window, which is most of the cost of initialising
+        initialised = true;
+        if (inflateReset2(strm, windowBits) != Z_OK) {
+            inflateEnd(strm);
+            initialised = false;
+        }
+    } else {
+        inflaterMisses.fetch_add(1, std::memory_order_relaxed);
+
+        strm = new z_stream{};
+        strm->zalloc = Z_NULL;
+        strm->zfree = Z_NULL;
+        strm->opaque = Z_NULL;
+        strm->avail_in = 0;
+        strm->next_in = Z_NULL;
+
+        initialised = inflateInit2(strm, windowBits) == Z_OK;
+    }
+
+    strm->avail_in = 0;
+    strm->next_in = Z_NULL;
+    strm->avail_out = 0;
+    strm->next_out = Z_NULL;
+}
+
+DatArchive::PooledInflater::~PooledInflater() {
+    if (initialised && threadCache.inflaters.size() < POOLEDPERTHREAD) {
+        threadCache.inflaters.push_back(strm);
+        return;
+    }
+
+    if (initialised) inflateEnd(strm);
+    delete strm;
+}
+
+bool DatArchive::PooledInflater::valid() const {
+    return initialised;
+}
+
+z_stream& DatArchive::PooledInflater::stream() const {
+    return *strm;
+}
+
+/*
+ * PooledBuffer
+ */
+
+DatArchive::PooledBuffer::PooledBuffer() {
+    if (!threadCache.buffers.empty()) {
+        buffer = threadCache.buffers.back();
+        threadCache.buffers.pop_back();
+        bufferHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        buffer = new unsigned char[CHUNKSIZE];
+        bufferMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+DatArchive::PooledBuffer::~PooledBuffer() {
+    if (threadCache.buffers.size() < POOLEDPERTHREAD) {
+        threadCache.buffers.push_back(buffer);
+    } else {
+        delete[] buffer;
+    }
+}
+
+unsigned char* DatArchive::PooledBuffer::get() const {
+    return buffer;
+}
+
+/*
+ * Counters
+ */
+
+DatArchive::PoolStats DatArchive::readPoolCounters() {
+    PoolStats stats;
+    stats.inflaterHits = inflaterHits.load(std::memory_order_relaxed);
+    stats.inflaterMisses = inflaterMisses.load(std::memory_order_relaxed);
+    stats.bufferHits = bufferHits.load(std::memory_order_relaxed);
+    stats.bufferMisses = bufferMisses.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void DatArchive::clearPoolCounters() {
+    inflaterHits.store(0, std::memory_order_relaxed);
+    inflaterMisses.store(0, std::memory_order_relaxed);
+    bufferHits.store(0, std::memory_order_relaxed);
+    bufferMisses.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+
+#include <zlib.h>
+
+#include "../include/dat-archive.h"
+
+namespace DatArchive {
+    /** The most inflate states and buffers each thread keeps for reuse */
+    constexpr size_t POOLEDPERTHREAD = 4;
+
+    /**
+     * An inflate state borrowed from the calling thread's cache, or initialised if the cache is empty
+     * <br>
+     * The state is reset when it is borrowed, and returned to the cache of whichever thread destroys this
+     */
+    class PooledInflater {
+        z_stream* strm;
+        bool initialised = false;
+
+    public:
+        /**
+         * @param windowBits The window bits to reset the state with, as given to inflateInit2
+         */
+        explicit PooledInflater(int windowBits = MAX_WBITS);
+
+        PooledInflater(const PooledInflater&) = delete;
+
+        PooledInflater& operator=(const PooledInflater&) = delete;
+
+        ~PooledInflater();
+
+        /**
+         * Check whether a state could be borrowed or initialised
+         * @return true if the state can be used
+         */
+        [[nodiscard]] bool valid() const;
+
+        /**
+         * Get the state, only usable for inflating if valid() is true
+         * @return The state
+         */
+        [[nodiscard]] z_stream& stream() const;
+    };
+
+    /**
+     * A CHUNKSIZE buffer borrowed from the calling thread's cache, or allocated if the cache is empty
+     * <br>
+     * The buffer is returned to the cache of whichever thread destroys this
+     */
+    class PooledBuffer {
+        unsigned char* buffer;
+
+    public:
+        PooledBuffer();
+
+        PooledBuffer(const PooledBuffer&) = delete;
+
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+        ~PooledBuffer();
+
+        /**
+         * Get the buffer
+         * @return The buffer, CHUNKSIZE bytes long
+         */
+        [[nodiscard]] unsigned char* get() const;
+    };
+
+    /**
+     * Get how often the caches of every thread were hit and missed
+     * @return The counts since the last clearPoolCounters()
+     */
+    PoolStats readPoolCounters();
+
+    /**
+     * Set every count returned by readPoolCounters() back to 0
+     */
+    void clearPoolCounters();
+}
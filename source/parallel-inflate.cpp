@@ -0,0 +1,849 @@
+#include "parallel-inflate.h"
+#include "fast-crc32.h"
+
+#include "../include/dat-archive.h"
+
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+    using DatArchive::INFLATEWINDOWSIZE;
+
+    /** Symbols at or above this refer to the data before the chunk, the rest of the symbol is the position in it */
+    constexpr uint16_t MARKER = 32768;
+
+    constexpr uint16_t LENGTHBASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+                                         99, 115, 131, 163, 195, 227, 258};
+    constexpr uint8_t LENGTHEXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5,
+                                         5, 0};
+    constexpr uint16_t DISTANCEBASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                           1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    constexpr uint8_t DISTANCEEXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+                                           11, 12, 12, 13, 13};
+
+    /** The order the code lengths of the precode are stored in */
+    constexpr uint8_t PRECODEORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    /**
+     * Reads a deflate stream a few bits at a time, starting from any bit
+     */
+    class BitReader {
+        const unsigned char* data;
+        uint64_t size;
+
+        uint64_t next = 0;
+        uint64_t buffer = 0;
+        unsigned count = 0;
+
+    public:
+        BitReader(const unsigned char* data, uint64_t size) : data(data), size(size) {}
+
+        /**
+         * Move to a bit in the stream
+         * @param bit The offset in bits from the start of the stream
+         */
+        void seek(uint64_t bit) {
+            next = bit / 8;
+            buffer = 0;
+            count = 0;
+
+            refill();
+            drop(bit % 8);
+        }
+
+        /**
+         * Top up the buffer so at least 56 bits can be read, past the end of the stream it is filled with zeros
+         */
+        void refill() {
+            if (next + 8 <= size) {
+                // Load a whole word and keep as many whole bytes of it as fit
+                uint64_t word;
+                memcpy(&word, data + next, 8);
+
+                buffer |= word << count;
+                next += (63 - count) >> 3;
+                count |= 56;
+                return;
+            }
+
+            while (count <= 56) {
+                buffer |= (uint64_t) (next < size ? data[next] : 0) << count;
+                ++next;
+                count += 8;
+            }
+        }
+
+        [[nodiscard]] uint64_t peek(unsigned bits) const {
+            return buffer & ((1ULL << bits) - 1);
+        }
+
+        void drop(unsigned bits) {
+            buffer >>= bits;
+            count -= bits;
+        }
+
+        uint64_t read(unsigned bits) {
+            uint64_t value = peek(bits);
+            drop(bits);
+
+            return value;
+        }
+
+        void alignToByte() {
+            drop(count % 8);
+        }
+
+        /**
+         * Get the offset in bits of the next bit that will be read
+         */
+        [[nodiscard]] uint64_t position() const {
+            return next * 8 - count;
+        }
+
+        /**
+         * Check whether more bits have been read than there are in the stream
+         */
+        [[nodiscard]] bool overrun() const {
+            return position() > size * 8;
+        }
+    };
+
+    /**
+     * The kinds of Huffman code in a deflate stream, which zlib validates differently
+     */
+    enum class CodeType : uint8_t {
+        PRECODE,
+        LITERALS,
+        DISTANCES
+    };
+
+    /**
+     * A canonical Huffman code, decoded through a lookup table for short codes and bit by bit for long ones
+     */
+    class Huffman {
+        static constexpr unsigned LOOKUPBITS = 10;
+
+        // Each lookup entry holds the symbol above the code length, 0 where the code is longer than the table
+        uint16_t lookup[1 << LOOKUPBITS];
+        uint16_t counts[16];
+        uint16_t symbols[288];
+
+    public:
+        /**
+         * Build the code from the length of each symbol's code
+         * @param lengths The length of the code of each symbol, 0 where the symbol isn't used
+         * @param symbolCount The number of symbols
+         * @param type The kind of code being built
+         * @return true if successful, false if zlib wouldn't accept the code either
+         */
+        bool build(const uint8_t* lengths, unsigned symbolCount, CodeType type) {
+            memset(counts, 0, sizeof(counts));
+            for (unsigned symbol = 0; symbol < symbolCount; ++symbol) counts[lengths[symbol]]++;
+            counts[0] = 0;
+
+            unsigned maxLength = 15;
+            while (maxLength > 0 && counts[maxLength] == 0) --maxLength;
+
+            int left = 1;
+            for (unsigned length = 1; length <= 15; ++length) {
+                left = (left << 1) - counts[length];
+                if (left < 0) return false;
+            }
+
+            // Like zlib, only accept an incomplete code if it is a single one bit code, or has no codes at all
+            if (left > 0 && maxLength > 0 && (type == CodeType::PRECODE || maxLength != 1)) return false;
+
+            uint16_t offsets[16];
+            uint32_t nextCode[16];
+            offsets[1] = 0;
+            nextCode[1] = 0;
+            for (unsigned length = 1; length < 15; ++length) {
+                offsets[length + 1] = offsets[length] + counts[length];
+                nextCode[length + 1] = (nextCode[length] + counts[length]) << 1;
+            }
+
+            memset(lookup, 0, sizeof(lookup));
+            for (unsigned symbol = 0; symbol < symbolCount; ++symbol) {
+                unsigned length = lengths[symbol];
+                if (length == 0) continue;
+
+                symbols[offsets[length]++] = symbol;
+
+                uint32_t code = nextCode[length]++;
+                if (length > LOOKUPBITS) continue;
+
+                // Codes are packed starting from their most significant bit, so they're looked up reversed
+                uint32_t reversed = 0;
+                for (unsigned bit = 0; bit < length; ++bit) reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+
+                for (uint32_t index = reversed; index < (1u << LOOKUPBITS); index += 1u << length) {
+                    lookup[index] = symbol << 4 | length;
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Decode the next symbol, the reader must have been refilled
+         * @param in The stream to read from
+         * @return The symbol, -1 if the bits aren't a valid code
+         */
+        int decode(BitReader& in) const {
+            uint16_t entry = lookup[in.peek(LOOKUPBITS)];
+            if (entry != 0) {
+                in.drop(entry & 15);
+                return entry >> 4;
+            }
+
+            uint64_t bits = in.peek(15);
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (unsigned length = 1; length <= 15; ++length) {
+                code |= (int) (bits >> (length - 1)) & 1;
+
+                int count = counts[length];
+                if (code - count < first) {
+                    in.drop(length);
+                    return symbols[index + (code - first)];
+                }
+
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+
+            return -1;
+        }
+    };
+
+    /**
+     * Get the fixed literal and length code
+     */
+    const Huffman& fixedLiterals() {
+        static const Huffman code = []() {
+            uint8_t lengths[288];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+
+            Huffman huffman;
+            huffman.build(lengths, 288, CodeType::LITERALS);
+            return huffman;
+        }();
+
+        return code;
+    }
+
+    /**
+     * Get the fixed distance code
+     */
+    const Huffman& fixedDistances() {
+        static const Huffman code = []() {
+            uint8_t lengths[32];
+            std::fill(lengths, lengths + 32, 5);
+
+            Huffman huffman;
+            huffman.build(lengths, 32, CodeType::DISTANCES);
+            return huffman;
+        }();
+
+        return code;
+    }
+
+    /**
+     * A growable array of symbols that, unlike std::vector, doesn't initialise the space it adds
+     */
+    template<typename Symbol>
+    class SymbolBuffer {
+        std::unique_ptr<Symbol[]> symbols;
+        size_t capacity = 0;
+
+    public:
+        [[nodiscard]] size_t size() const {
+            return capacity;
+        }
+
+        Symbol* data() {
+            return symbols.get();
+        }
+
+        const Symbol* data() const {
+            return symbols.get();
+        }
+
+        Symbol operator[](size_t index) const {
+            return symbols[index];
+        }
+
+        /**
+         * Grow the buffer, keeping what it already holds
+         * @param size The number of symbols to make room for, nothing happens if there is already room
+         */
+        void resize(size_t size) {
+            if (size <= capacity) return;
+
+            std::unique_ptr<Symbol[]> grown(new Symbol[size]);
+            std::copy(symbols.get(), symbols.get() + capacity, grown.get());
+
+            symbols = std::move(grown);
+            capacity = size;
+        }
+    };
+
+    /**
+     * What a chunk decoded to, and where it started and finished in the stream
+     * <br>
+     * The output is split in two. The first part may hold markers, and is kept as 16 bit symbols. Once the last
+     * INFLATEWINDOWSIZE symbols hold no markers no more can appear, so the rest is kept as bytes, following a copy of
+     * those symbols so it can refer back to them.
+     */
+    struct ChunkResult {
+        bool valid = false;
+        bool streamEnd = false;
+
+        /** The range of bits the chunk could have started from, all giving the same output */
+        uint64_t startBit = 0;
+        uint64_t startBitMax = 0;
+        uint64_t endBit = 0;
+
+        SymbolBuffer<uint16_t> marked;
+        size_t markedSize = 0;
+
+        SymbolBuffer<uint8_t> plain;
+        size_t plainSize = 0;
+        size_t history = 0;
+
+        [[nodiscard]] uint64_t size() const {
+            return markedSize + plainSize - history;
+        }
+    };
+
+    /**
+     * Decodes part of a deflate stream, from a known block boundary or one it finds itself
+     */
+    class ChunkDecoder {
+        const unsigned char* source;
+        uint64_t sourceSize;
+
+        BitReader in;
+        Huffman precode;
+        Huffman literals;
+        Huffman distances;
+
+        size_t lastMarkerEnd = 0;
+
+        /**
+         * Read the code lengths at the start of a dynamic block and build its codes
+         * @return true if successful, false if the header is invalid
+         */
+        bool readDynamicHeader() {
+            in.refill();
+            unsigned literalCount = in.read(5) + 257;
+            unsigned distanceCount = in.read(5) + 1;
+            unsigned precodeCount = in.read(4) + 4;
+            if (literalCount > 286 || distanceCount > 30) return false;
+
+            uint8_t lengths[286 + 30] = {};
+            for (unsigned i = 0; i < precodeCount; ++i) {
+                in.refill();
+                lengths[PRECODEORDER[i]] = in.read(3);
+            }
+            if (!precode.build(lengths, 19, CodeType::PRECODE)) return false;
+
+            memset(lengths, 0, 19);
+
+            unsigned index = 0;
+            while (index < literalCount + distanceCount) {
+                in.refill();
+
+                int symbol = precode.decode(in);
+                if (symbol < 0) return false;
+
+                if (symbol < 16) {
+                    lengths[index++] = symbol;
+                    continue;
+                }
+
+                uint8_t repeated = 0;
+                unsigned repeat;
+                if (symbol == 16) {
+                    if (index == 0) return false;
+                    repeated = lengths[index - 1];
+                    repeat = 3 + in.read(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + in.read(3);
+                } else {
+                    repeat = 11 + in.read(7);
+                }
+
+                if (index + repeat > literalCount + distanceCount) return false;
+                std::fill(lengths + index, lengths + index + repeat, repeated);
+                index += repeat;
+            }
+
+            // Every block has to be able to end
+            if (lengths[256] == 0) return false;
+
+            return literals.build(lengths, literalCount, CodeType::LITERALS)
+                   && distances.build(lengths + literalCount, distanceCount, CodeType::DISTANCES);
+        }
+
+        template<typename Symbol>
+        static void reserve(SymbolBuffer<Symbol>& output, size_t size) {
+            if (size > output.size()) output.resize(std::max(output.size() * 2, size));
+        }
+
+        /**
+         * Copy the contents of a stored block to the output
+         * @return true if successful
+         */
+        template<typename Symbol>
+        bool copyStored(SymbolBuffer<Symbol>& output, size_t& size) {
+            in.alignToByte();
+            in.refill();
+
+            uint64_t length = in.read(16);
+            uint64_t complement = in.read(16);
+            if (length != (~complement & 0xFFFF)) return false;
+
+            uint64_t start = in.position() / 8;
+            if (start + length > sourceSize) return false;
+
+            reserve(output, size + length);
+            std::copy(source + start, source + start + length, output.data() + size);
+            size += length;
+
+            in.seek((start + length) * 8);
+            return true;
+        }
+
+        /**
+         * Decode the data of a block compressed with the given codes
+         * <br>
+         * When decoding into 16 bit symbols, references to data before the chunk become markers
+         * @return true if successful
+         */
+        template<typename Symbol>
+        bool inflateBlock(const Huffman& literalCode, const Huffman& distanceCode, SymbolBuffer<Symbol>& output,
+                          size_t& size) {
+            constexpr bool marking = std::is_same_v<Symbol, uint16_t>;
+
+            while (true) {
+                reserve(output, size + 258);
+                Symbol* out = output.data();
+
+                in.refill();
+                if (in.overrun()) return false;
+
+                int symbol = literalCode.decode(in);
+                if (symbol < 256) {
+                    if (symbol < 0) return false;
+
+                    out[size++] = symbol;
+                    continue;
+                }
+                if (symbol == 256) return true;
+
+                symbol -= 257;
+                if (symbol >= 29) return false;
+                size_t length = LENGTHBASE[symbol] + in.read(LENGTHEXTRA[symbol]);
+
+                int distanceSymbol = distanceCode.decode(in);
+                if (distanceSymbol < 0 || distanceSymbol >= 30) return false;
+                size_t distance = DISTANCEBASE[distanceSymbol] + in.read(DISTANCEEXTRA[distanceSymbol]);
+
+                if (distance > size) {
+                    if constexpr (!marking) {
+                        return false;
+                    } else {
+                        for (size_t end = size + length; size < end; ++size) {
+                            out[size] = distance > size ? MARKER + (INFLATEWINDOWSIZE + size - distance)
+                                                        : out[size - distance];
+                        }
+                        lastMarkerEnd = size;
+                        continue;
+                    }
+                }
+
+                if constexpr (marking) {
+                    // Copying markers copies what they refer to, so they have to be tracked
+                    uint16_t copied = 0;
+                    for (size_t end = size + length; size < end; ++size) {
+                        out[size] = out[size - distance];
+                        copied |= out[size];
+                    }
+                    if (copied & MARKER) lastMarkerEnd = size;
+                } else {
+                    for (size_t end = size + length; size < end; ++size) out[size] = out[size - distance];
+                }
+            }
+        }
+
+        /**
+         * Decode a single block of any type
+         * @return true if successful
+         */
+        template<typename Symbol>
+        bool decodeBlock(unsigned type, SymbolBuffer<Symbol>& output, size_t& size) {
+            switch (type) {
+                case 0:
+                    return copyStored(output, size);
+                case 1:
+                    return inflateBlock(fixedLiterals(), fixedDistances(), output, size);
+                case 2:
+                    return readDynamicHeader() && inflateBlock(literals, distances, output, size);
+                default:
+                    return false;
+            }
+        }
+
+    public:
+        ChunkDecoder(const unsigned char* source, uint64_t sourceSize) : source(source), sourceSize(sourceSize),
+                                                                          in(source, sourceSize) {}
+
+        /**
+         * Find the first bit in a range that looks like the start of a stored or dynamic block
+         * <br>
+         * This is a guess, a match isn't certain to be a real block, and blocks with fixed codes are never found
+         * @param from The first bit to check
+         * @param to The bit to stop checking at
+         * @param startBitMax Set to the last bit that would give the same block, stored blocks can be found from any
+         * of the zero bits that pad their header
+         * @return The bit the block starts at, UINT64_MAX if there isn't one
+         */
+        uint64_t findBlock(uint64_t from, uint64_t to, uint64_t& startBitMax) {
+            for (uint64_t bit = from; bit < to; ++bit) {
+                in.seek(bit);
+                uint64_t header = in.peek(3);
+
+                // Only look for blocks that aren't the last, since the last block can be left to the previous chunk
+                if (header == 0) {
+                    uint64_t byte = (bit + 3 + 7) / 8;
+                    if (byte + 4 > sourceSize) continue;
+
+                    // The header is padded to the next byte with zeros
+                    in.drop(3);
+                    if (in.peek(byte * 8 - bit - 3) != 0) continue;
+
+                    uint16_t length = source[byte] | source[byte + 1] << 8;
+                    uint16_t complement = source[byte + 2] | source[byte + 3] << 8;
+                    if (length != (uint16_t) ~complement) continue;
+
+                    startBitMax = byte * 8 - 3;
+                    return bit;
+                }
+
+                if (header == 4) {
+                    in.drop(3);
+                    if (!readDynamicHeader()) continue;
+
+                    startBitMax = bit;
+                    return bit;
+                }
+            }
+
+            return UINT64_MAX;
+        }
+
+        /**
+         * Decode blocks from a block boundary, until the first block ending at or after a bit or the end of the stream
+         * @param startBit The bit the first block starts at
+         * @param stopBit The bit to stop after
+         * @param window The data preceding the first block, nullptr if it isn't known
+         * @param result Set to the output
+         * @return true if successful
+         */
+        bool decode(uint64_t startBit, uint64_t stopBit, const std::vector<unsigned char>* window,
+                    ChunkResult& result) {
+            bool marking = window == nullptr;
+
+            result.markedSize = 0;
+            result.plainSize = 0;
+            result.history = 0;
+            result.streamEnd = false;
+            lastMarkerEnd = 0;
+
+            // Start with room for a high compression ratio so the output rarely has to be moved, the buffers aren't
+            // initialised so the pages that go unused are never touched
+            size_t expectedSize = (stopBit - std::min(startBit, stopBit)) / 8 * 10 + INFLATEWINDOWSIZE;
+
+            if (marking) {
+                result.marked.resize(expectedSize);
+            } else {
+                result.plain.resize(expectedSize);
+                std::copy(window->begin(), window->end(), result.plain.data());
+                result.plainSize = window->size();
+                result.history = window->size();
+            }
+
+            in.seek(startBit);
+            while (true) {
+                in.refill();
+                bool last = in.read(1);
+                unsigned type = in.read(2);
+
+                bool ok = marking ? decodeBlock(type, result.marked, result.markedSize)
+                                  : decodeBlock(type, result.plain, result.plainSize);
+                if (!ok || in.overrun()) return false;
+
+                if (last) {
+                    result.streamEnd = true;
+                    result.endBit = in.position();
+                    return true;
+                }
+
+                // Once the window holds no markers, no more can appear
+                if (marking && result.markedSize - lastMarkerEnd >= INFLATEWINDOWSIZE) {
+                    result.plain.resize(expectedSize);
+                    std::copy(result.marked.data() + result.markedSize - INFLATEWINDOWSIZE,
+                              result.marked.data() + result.markedSize, result.plain.data());
+                    result.plainSize = INFLATEWINDOWSIZE;
+                    result.history = INFLATEWINDOWSIZE;
+                    marking = false;
+                }
+
+                if (in.position() >= stopBit) {
+                    result.endBit = in.position();
+                    return true;
+                }
+            }
+        }
+    };
+
+    /**
+     * Decode a chunk whose preceding data is known, from a block boundary that is known to be real
+     */
+    ChunkResult decodeFrom(const unsigned char* source, uint64_t sourceSize, uint64_t startBit, uint64_t stopBit,
+                           const std::vector<unsigned char>& window) {
+        auto decoder = std::make_unique<ChunkDecoder>(source, sourceSize);
+
+        ChunkResult result;
+        result.valid = decoder->decode(startBit, stopBit, &window, result);
+        result.startBit = startBit;
+        result.startBitMax = startBit;
+
+        return result;
+    }
+
+    /**
+     * Decode a chunk from the first block found in a range, without knowing the preceding data
+     */
+    ChunkResult decodeSpeculatively(const unsigned char* source, uint64_t sourceSize, uint64_t fromBit, uint64_t toBit,
+                                    uint64_t stopBit) {
+        auto decoder = std::make_unique<ChunkDecoder>(source, sourceSize);
+
+        ChunkResult result;
+        for (uint64_t bit = fromBit; bit < toBit; ++bit) {
+            uint64_t startBitMax = 0;
+            bit = decoder->findBlock(bit, toBit, startBitMax);
+            if (bit == UINT64_MAX) break;
+
+            // A false match usually fails to decode quickly, so carry on looking after it
+            if (decoder->decode(bit, stopBit, nullptr, result)) {
+                result.valid = true;
+                result.startBit = bit;
+                result.startBitMax = startBitMax;
+                break;
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * Get a byte of a chunk's output
+     * @param result The chunk
+     * @param index The position of the byte in the chunk's output
+     * @param window The data preceding the chunk
+     * @return The byte, nullopt if it refers to data before the start of the stream
+     */
+    std::optional<unsigned char> resolve(const ChunkResult& result, uint64_t index,
+                                         const std::vector<unsigned char>& window) {
+        if (index >= result.markedSize) return result.plain[result.history + index - result.markedSize];
+
+        uint16_t symbol = result.marked[index];
+        if (symbol < MARKER) return symbol;
+
+        uint64_t fromEnd = INFLATEWINDOWSIZE - (symbol - MARKER);
+        if (fromEnd > window.size()) return std::nullopt;
+
+        return window[window.size() - fromEnd];
+    }
+
+    /**
+     * Write a chunk's output into place, replacing its markers
+     * @return The Adler-32 checksum of the output, nullopt if it refers to data before the start of the stream
+     */
+    std::optional<uLong> writeChunk(const ChunkResult& result, const std::vector<unsigned char>& window,
+                                    unsigned char* destination) {
+        // Markers can only refer to the part of the window that exists
+        const size_t lowestMarker = MARKER + INFLATEWINDOWSIZE - window.size();
+
+        for (size_t i = 0; i < result.markedSize; ++i) {
+            uint16_t symbol = result.marked[i];
+
+            if (symbol < MARKER) {
+                destination[i] = symbol;
+            } else if (symbol >= lowestMarker) {
+                destination[i] = window[symbol - lowestMarker];
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        if (result.plainSize > result.history) {
+            memcpy(destination + result.markedSize, result.plain.data() + result.history,
+                   result.plainSize - result.history);
+        }
+
+        return adler32_z(adler32(0L, Z_NULL, 0), destination, result.size());
+    }
+}
+
+bool DatArchive::parallelInflate(const unsigned char* source, uint64_t sourceSize, unsigned char* destination,
+                                 uint64_t destinationSize, DatArchive::ThreadPool& pool, uint32_t& sourceCrc) {
+    // Only deflate streams without a preset dictionary can be handled
+    if (sourceSize < 6) return false;
+    if ((source[0] & 0x0F) != Z_DEFLATED || (source[0] >> 4) > 7 || (source[1] & 0x20) != 0
+        || (source[0] << 8 | source[1]) % 31 != 0) {
+        return false;
+    }
+
+    const uint64_t chunkCount = (sourceSize - 1) / PARALLELINFLATECHUNKSIZE + 1;
+
+    // The checksum of the stream is calculated in slices alongside, then combined at the end
+    std::vector<std::future<uint32_t>> sliceCrcs;
+    for (uint64_t chunk = 0; chunk < chunkCount; ++chunk) {
+        uint64_t start = chunk * PARALLELINFLATECHUNKSIZE;
+        uint64_t length = std::min(PARALLELINFLATECHUNKSIZE, sourceSize - start);
+
+        sliceCrcs.push_back(pool.submit([source, start, length]() {
+            return fastCrc32(0, source + start, length);
+        }));
+    }
+
+    // Decode a few chunks per thread at a time, to bound how much is held in memory
+    const uint64_t waveSize = std::max<size_t>(2, pool.size() * 2);
+
+    uint64_t cursor = 16;
+    uint64_t written = 0;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    std::vector<unsigned char> window;
+
+    bool failed = false;
+    bool streamEnd = false;
+    while (!failed && !streamEnd) {
+        // The chunk holding the cursor is decoded with the known window, the rest are guesses
+        uint64_t first = cursor / 8 / PARALLELINFLATECHUNKSIZE;
+        uint64_t last = std::min(chunkCount, first + waveSize);
+
+        // A stream that hasn't ended by the end of the data is truncated
+        if (first >= chunkCount) {
+            failed = true;
+            break;
+        }
+
+        std::vector<std::future<ChunkResult>> decoding;
+        for (uint64_t chunk = first; chunk < last; ++chunk) {
+            uint64_t fromBit = chunk * PARALLELINFLATECHUNKSIZE * 8;
+            uint64_t stopBit = std::min(fromBit + PARALLELINFLATECHUNKSIZE * 8, sourceSize * 8);
+
+            if (chunk == first) {
+                decoding.push_back(pool.submit([source, sourceSize, cursor, stopBit, window]() {
+                    return decodeFrom(source, sourceSize, cursor, stopBit, window);
+                }));
+            } else {
+                decoding.push_back(pool.submit([source, sourceSize, fromBit, stopBit]() {
+                    return decodeSpeculatively(source, sourceSize, fromBit, stopBit, stopBit);
+                }));
+            }
+        }
+
+        std::vector<ChunkResult> results;
+        results.reserve(decoding.size());
+        for (std::future<ChunkResult>& result: decoding) results.push_back(result.get());
+
+        if (!results.front().valid) {
+            failed = true;
+            break;
+        }
+
+        // Keep each chunk that starts exactly where the last one finished, stopping at the first that doesn't
+        struct Accepted {
+            const ChunkResult* result;
+            std::vector<unsigned char> window;
+            uint64_t offset;
+        };
+        std::vector<Accepted> accepted;
+
+        for (const ChunkResult& result: results) {
+            if (!result.valid || result.startBitMax < cursor) continue;
+            if (result.startBit > cursor) break;
+
+            if (written + result.size() > destinationSize) {
+                failed = true;
+                break;
+            }
+            accepted.push_back({&result, window, written});
+
+            // Work out the window for the next chunk, which only needs the end of this one resolved
+            std::vector<unsigned char> nextWindow;
+            uint64_t resolvedStart = result.size() - std::min<uint64_t>(result.size(), INFLATEWINDOWSIZE);
+            uint64_t kept = std::min<uint64_t>(window.size(), INFLATEWINDOWSIZE - (result.size() - resolvedStart));
+
+            nextWindow.insert(nextWindow.end(), window.end() - (long) kept, window.end());
+            for (uint64_t i = resolvedStart; i < result.size() && !failed; ++i) {
+                std::optional<unsigned char> byte = resolve(result, i, window);
+                if (!byte) failed = true;
+                else nextWindow.push_back(*byte);
+            }
+            window = std::move(nextWindow);
+
+            written += result.size();
+            cursor = result.endBit;
+            streamEnd = result.streamEnd;
+            if (failed || streamEnd) break;
+        }
+
+        // Write the kept chunks into place
+        std::vector<std::future<std::optional<uLong>>> writing;
+        for (const Accepted& chunk: accepted) {
+            writing.push_back(pool.submit([&chunk, destination]() {
+                return writeChunk(*chunk.result, chunk.window, destination + chunk.offset);
+            }));
+        }
+
+        for (size_t i = 0; i < writing.size(); ++i) {
+            std::optional<uLong> chunkAdler = writing[i].get();
+
+            if (!chunkAdler) failed = true;
+            else adler = adler32_combine(adler, *chunkAdler, (z_off_t) accepted[i].result->size());
+        }
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (uint64_t chunk = 0; chunk < chunkCount; ++chunk) {
+        uint64_t length = std::min(PARALLELINFLATECHUNKSIZE, sourceSize - chunk * PARALLELINFLATECHUNKSIZE);
+        crc = crc32_combine(crc, sliceCrcs[chunk].get(), (z_off_t) length);
+    }
+    sourceCrc = crc;
+
+    if (failed || written != destinationSize) return false;
+
+    // The stream finishes with the Adler-32 checksum of the data, in the byte following the last block
+    uint64_t trailer = (cursor + 7) / 8;
+    if (trailer + 4 > sourceSize) return false;
+
+    uLong expectedAdler = (uLong) source[trailer] << 24 | (uLong) source[trailer + 1] << 16
+                          | (uLong) source[trailer + 2] << 8 | source[trailer + 3];
+
+    return adler == expectedAdler;
+}
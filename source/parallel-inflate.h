@@ -0,0 +1,40 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+#include "thread-pool.h"
+
+namespace DatArchive {
+    /** The amount of compressed data each task starts decoding from in a parallel inflate */
+    constexpr uint64_t PARALLELINFLATECHUNKSIZE = 4194304;
+
+    /**
+     * The fewest threads, and cores, a parallel inflate is used with
+     * <br>
+     * It costs 4 to 8 times the CPU time of zlib, so with fewer cores it is slower than inflating on one thread.
+     */
+    constexpr unsigned PARALLELINFLATEMINIMUMTHREADS = 16;
+
+    /**
+     * Inflate a zlib stream using every thread of a pool
+     * <br>
+     * The stream is split into chunks of PARALLELINFLATECHUNKSIZE bytes. Each chunk searches for the first deflate
+     * block that starts inside it and decodes from there before the data preceding it is known, leaving markers where
+     * it refers back into that data. The chunks are then joined in order, with each chunk only kept if it started
+     * exactly where the one before it finished, and the markers are replaced once the data they refer to is known.
+     * Chunks that guessed wrong are decoded again from where the previous chunk finished.
+     * <br>
+     * This doesn't use zlib to decode, so the result is checked against the stream's Adler-32 checksum before it is
+     * accepted.
+     * @param source The zlib stream
+     * @param sourceSize The size of the zlib stream in bytes
+     * @param destination The buffer to inflate into
+     * @param destinationSize The size of the inflated data, the stream must inflate to exactly this many bytes
+     * @param pool The threads to inflate with
+     * @param sourceCrc Set to the CRC32 checksum of the zlib stream, calculated while inflating
+     * @return true if successful, false if the stream couldn't be inflated this way, in which case it should be
+     * inflated with zlib instead
+     */
+    bool parallelInflate(const unsigned char* source, uint64_t sourceSize, unsigned char* destination,
+                         uint64_t destinationSize, ThreadPool& pool, uint32_t& sourceCrc);
+}
@@ -0,0 +1,45 @@
+#include "thread-pool.h"
+
+#include <algorithm>
+
+DatArchive::ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+DatArchive::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+
+    for (std::thread& thread: threads) thread.join();
+}
+
+size_t DatArchive::ThreadPool::size() const {
+    return threads.size();
+}
+
+void DatArchive::ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            // Only stop once the queue has drained, so every submitted future gets its result
+            if (tasks.empty()) return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DatArchive {
+    /**
+     * A fixed set of threads that run submitted tasks in the order they were submitted
+     * <br>
+     * Tasks must not wait on other tasks submitted to the same pool, as every thread could end up waiting
+     */
+    class ThreadPool {
+        std::vector<std::thread> threads;
+
+        std::deque<std::function<void()>> tasks;
+        std::mutex taskMutex;
+        std::condition_variable taskAvailable;
+        bool stopping = false;
+
+        /**
+         * Run tasks until the pool is destroyed
+         */
+        void work();
+
+    public:
+        /**
+         * @param threadCount The number of threads to start, 0 to start one for each core
+         */
+        explicit ThreadPool(size_t threadCount);
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * Finish every task that has already been submitted, then stop the threads
+         */
+        ~ThreadPool();
+
+        /**
+         * Get the number of threads in the pool
+         * @return The number of threads in the pool
+         */
+        [[nodiscard]] size_t size() const;
+
+        /**
+         * Queue a task to run on one of the threads
+         * @param task The task to run
+         * @return A future holding the result of the task, or the exception it threw
+         */
+        template<typename Task>
+        auto submit(Task task) -> std::future<decltype(task())> {
+            auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+            std::future<decltype(task())> result = packagedTask->get_future();
+
+            {
+                std::lock_guard<std::mutex> lock(taskMutex);
+                tasks.emplace_back([packagedTask]() { (*packagedTask)(); });
+            }
+            taskAvailable.notify_one();
+
+            return result;
+        }
+    };
+}
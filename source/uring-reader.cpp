@@ -0,0 +1,339 @@
+#include "uring-reader.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+    /** The most entries a ring is created with, well under the kernel's limit */
+    constexpr unsigned MAXQUEUEDEPTH = 4096;
+
+    int uringSetup(unsigned entries, io_uring_params* params) {
+        return (int) syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int uringEnter(int ringDescriptor, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, ringDescriptor, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    /**
+     * A read in flight, owned by the ring until it completes
+     */
+    struct Request {
+        uint64_t offset;
+        std::vector<char> data;
+        uint64_t done = 0;
+        iovec iov{};
+        DatArchive::UringReader::Completion completion;
+    };
+}
+
+struct DatArchive::UringReader::Ring {
+    int fileDescriptor = -1;
+    int ringDescriptor = -1;
+    // Written to wake the completion thread when the reader is destroyed
+    int wakeDescriptor = -1;
+
+    // The mappings shared with the kernel
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    void* sqeArray = MAP_FAILED;
+    size_t sqeArraySize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqIndices = nullptr;
+    io_uring_sqe* sqes = nullptr;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // Submissions come from any thread, so they take turns
+    std::mutex submitMutex;
+    std::condition_variable slotFreed;
+    unsigned queueDepth = 0;
+    unsigned inFlight = 0;
+
+    // Set once the kernel refuses a submission, after which no more are made
+    bool broken = false;
+    // Requests published to the kernel that it then refused, kept until the ring is closed in case it looks at them
+    std::vector<std::unique_ptr<Request>> stranded;
+
+    // Set once every read has finished and the completion thread should stop
+    bool stopping = false;
+    std::thread completionThread;
+
+    ~Ring() {
+        if (sqeArray != MAP_FAILED) munmap(sqeArray, sqeArraySize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+
+        if (wakeDescriptor >= 0) close(wakeDescriptor);
+        if (ringDescriptor >= 0) close(ringDescriptor);
+        if (fileDescriptor >= 0) close(fileDescriptor);
+    }
+
+    /**
+     * Hand a request to the kernel, the submit mutex must be held and the ring must not be broken
+     * <br>
+     * The request is published to the kernel before it is told about it, so if it is then refused it can't be taken
+     * back. The ring is marked broken and keeps the request, and only its completion is left to the caller.
+     * @param request The request to read the rest of
+     * @return true if the request was submitted
+     */
+    bool submit(Request* request) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fileDescriptor;
+        sqe.addr = reinterpret_cast<uint64_t>(&request->iov);
+        sqe.len = 1;
+        sqe.off = request->offset + request->done;
+        sqe.user_data = reinterpret_cast<uint64_t>(request);
+
+        sqIndices[index] = index;
+        std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+
+        int submitted;
+        do {
+            submitted = uringEnter(ringDescriptor, 1, 0, 0);
+        } while (submitted < 0 && errno == EINTR);
+
+        if (submitted == 1) return true;
+
+        broken = true;
+        stranded.emplace_back(request);
+        slotFreed.notify_all();
+
+        return false;
+    }
+
+    /**
+     * Run a request's completion and free up its slot
+     * @param completion The request's completion
+     * @param success Whether the whole range was read
+     * @param data The data that was read
+     */
+    void finish(const DatArchive::UringReader::Completion& completion, bool success, std::vector<char> data) {
+        completion(success, std::move(data));
+
+        {
+            std::lock_guard<std::mutex> lock(submitMutex);
+            --inFlight;
+        }
+        slotFreed.notify_all();
+    }
+
+    /**
+     * Handle a completed read, either finishing the request or submitting the rest of it
+     * @param request The request
+     * @param result The result of the read, the number of bytes read or a negative error number
+     */
+    void handle(Request* request, int result) {
+        uint64_t size = request->data.size();
+
+        // Reads can come back short, or be interrupted, in which case the rest is read
+        bool retry = result == -EINTR || result == -EAGAIN;
+        if (result > 0 && request->done + result < size) {
+            request->done += result;
+            request->iov.iov_base = request->data.data() + request->done;
+            request->iov.iov_len = size - request->done;
+            retry = true;
+        }
+
+        if (retry) {
+            std::unique_lock<std::mutex> lock(submitMutex);
+            if (!broken) {
+                if (submit(request)) return;
+
+                // The ring has kept the refused request, so it is only failed
+                DatArchive::UringReader::Completion completion = std::move(request->completion);
+                lock.unlock();
+
+                finish(completion, false, {});
+                return;
+            }
+        }
+
+        bool success = !retry && result >= 0 && request->done + result == size;
+
+        std::unique_ptr<Request> finished(request);
+        finish(finished->completion, success, success ? std::move(finished->data) : std::vector<char>());
+    }
+
+    /**
+     * Wait for and handle completions until the reader is stopped
+     * <br>
+     * The thread waits on the ring and the wake descriptor together rather than in io_uring_enter(), so it can always
+     * be woken to stop, and an error waiting only means waiting again.
+     */
+    void complete() {
+        pollfd waitOn[] = {{ringDescriptor, POLLIN, 0}, {wakeDescriptor, POLLIN, 0}};
+
+        while (true) {
+            poll(waitOn, 2, -1);
+
+            unsigned head = *cqHead;
+            unsigned tail = std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire);
+
+            // Requests are submitted under the mutex, taking it here orders their setup before handling them in a
+            // way that tools like ThreadSanitizer can see, as they don't know about the kernel passing them back
+            {
+                std::lock_guard<std::mutex> lock(submitMutex);
+                if (stopping) return;
+            }
+
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                auto* request = reinterpret_cast<Request*>(cqe.user_data);
+                int result = cqe.res;
+
+                // Free the entry before handling it, handling may submit more reads
+                std::atomic_ref<unsigned>(*cqHead).store(head + 1, std::memory_order_release);
+
+                handle(request, result);
+            }
+        }
+    }
+};
+
+DatArchive::UringReader::UringReader(std::unique_ptr<Ring> ring) : ring(std::move(ring)) {}
+
+DatArchive::UringReader::~UringReader() {
+    {
+        std::unique_lock<std::mutex> lock(ring->submitMutex);
+        ring->slotFreed.wait(lock, [this]() { return ring->inFlight == 0; });
+        ring->stopping = true;
+    }
+
+    uint64_t wake = 1;
+    while (write(ring->wakeDescriptor, &wake, sizeof(wake)) < 0 && errno == EINTR) {}
+
+    ring->completionThread.join();
+}
+
+std::unique_ptr<DatArchive::UringReader> DatArchive::UringReader::create(const std::filesystem::path& path,
+                                                                         unsigned queueDepth) {
+    auto ring = std::make_unique<Ring>();
+    ring->queueDepth = std::clamp(queueDepth, 1u, MAXQUEUEDEPTH);
+
+    ring->fileDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (ring->fileDescriptor < 0) return nullptr;
+
+    // Fails where the kernel is too old or io_uring has been disabled, such as in some containers
+    io_uring_params params{};
+    ring->ringDescriptor = uringSetup(ring->queueDepth, &params);
+    if (ring->ringDescriptor < 0) return nullptr;
+
+    ring->wakeDescriptor = eventfd(0, EFD_CLOEXEC);
+    if (ring->wakeDescriptor < 0) return nullptr;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Newer kernels share one mapping between both rings
+    bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping) ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ringDescriptor, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) return nullptr;
+
+    ring->cqRing = singleMapping ? ring->sqRing : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                                                       MAP_SHARED | MAP_POPULATE, ring->ringDescriptor,
+                                                       IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) return nullptr;
+
+    ring->sqeArraySize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqeArray = mmap(nullptr, ring->sqeArraySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->ringDescriptor, IORING_OFF_SQES);
+    if (ring->sqeArray == MAP_FAILED) return nullptr;
+
+    auto* sqRing = static_cast<char*>(ring->sqRing);
+    ring->sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+    ring->sqIndices = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+    ring->sqes = static_cast<io_uring_sqe*>(ring->sqeArray);
+
+    auto* cqRing = static_cast<char*>(ring->cqRing);
+    ring->cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+    ring->completionThread = std::thread(&Ring::complete, ring.get());
+
+    return std::unique_ptr<UringReader>(new UringReader(std::move(ring)));
+}
+
+void DatArchive::UringReader::read(uint64_t offset, uint64_t size, Completion completion) {
+    if (size == 0) {
+        completion(true, {});
+        return;
+    }
+
+    auto request = std::make_unique<Request>();
+    request->offset = offset;
+    request->data.resize(size);
+    request->iov.iov_base = request->data.data();
+    request->iov.iov_len = size;
+
+    {
+        std::unique_lock<std::mutex> lock(ring->submitMutex);
+        ring->slotFreed.wait(lock, [this]() { return ring->broken || ring->inFlight < ring->queueDepth; });
+
+        if (!ring->broken) {
+            request->completion = std::move(completion);
+
+            // The ring takes the request either way, if it is refused only the completion is taken back
+            Request* submitted = request.release();
+            if (ring->submit(submitted)) {
+                ++ring->inFlight;
+                return;
+            }
+
+            completion = std::move(submitted->completion);
+        }
+    }
+
+    completion(false, {});
+}
+#else
+struct DatArchive::UringReader::Ring {};
+
+DatArchive::UringReader::UringReader(std::unique_ptr<Ring> ring) : ring(std::move(ring)) {}
+
+DatArchive::UringReader::~UringReader() = default;
+
+std::unique_ptr<DatArchive::UringReader> DatArchive::UringReader::create(const std::filesystem::path& path,
+                                                                         unsigned queueDepth) {
+    // io_uring is only available on Linux
+    return nullptr;
+}
+
+void DatArchive::UringReader::read(uint64_t offset, uint64_t size, Completion completion) {
+    completion(false, {});
+}
+#endif
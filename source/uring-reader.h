@@ -0,0 +1,57 @@
+#pragma once
+#include <cinttypes>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace DatArchive {
+    /**
+     * Reads parts of a file asynchronously through io_uring, so a single thread can keep many reads in flight
+     * <br>
+     * The ring is driven with raw system calls rather than through liburing, and completions are handled on a thread
+     * owned by the reader.
+     */
+    class UringReader {
+        struct Ring;
+        std::unique_ptr<Ring> ring;
+
+        explicit UringReader(std::unique_ptr<Ring> ring);
+
+    public:
+        /**
+         * Called once a read has finished, on the reader's completion thread, with whether the whole range was read and
+         * the data that was read
+         */
+        using Completion = std::function<void(bool, std::vector<char>)>;
+
+        UringReader(const UringReader&) = delete;
+
+        UringReader& operator=(const UringReader&) = delete;
+
+        /**
+         * Wait for every read in flight to finish, then wake and join the completion thread
+         */
+        ~UringReader();
+
+        /**
+         * Open a file for asynchronous reads
+         * @param path The path to the file
+         * @param queueDepth The most reads to keep in flight at once
+         * @return The reader, nullptr if io_uring isn't available or the file couldn't be opened
+         */
+        static std::unique_ptr<UringReader> create(const std::filesystem::path& path, unsigned queueDepth);
+
+        /**
+         * Start reading part of the file
+         * <br>
+         * This waits for an earlier read to finish if there are already queueDepth reads in flight. If the kernel ever
+         * refuses a read, the reader stops using the ring, and this and every later read fails straight away on the
+         * calling thread.
+         * @param offset The offset into the file to read from
+         * @param size The number of bytes to read
+         * @param completion Called with the data once it has been read
+         */
+        void read(uint64_t offset, uint64_t size, Completion completion);
+    };
+}